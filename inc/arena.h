@@ -0,0 +1,68 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Arena (bump) allocator for loader and tool scratch memory
+//
+// Memory comes from the program break when it can be extended, otherwise
+// from large lazily-touched mmap chunks, so a whole load needs O(1)
+// allocation syscalls. Individual allocations are never freed; instead
+// take an arena_mark() at the start of a phase and arena_reset() to it
+// afterwards. Chunks are kept and reused after a reset.
+
+// Size of the chunk taken from brk or mmap when the arena runs out
+#define ARENA_CHUNK_SIZE (64UL << 20)
+
+struct arena_chunk;
+
+struct arena_stats {
+    size_t in_use;             // bytes handed out and not yet reset
+    size_t high_water;         // largest in_use seen
+    size_t reserved;           // bytes of address space held in chunks
+    unsigned long mmap_calls;  // chunks obtained with mmap
+    unsigned long brk_calls;   // brk syscalls issued
+};
+
+struct arena {
+    struct arena_chunk *head;  // first chunk
+    struct arena_chunk *cur;   // chunk being carved up
+    size_t offset;             // bytes used in cur, header included
+    struct arena_stats stats;
+};
+
+// Position to return to with arena_reset()
+struct arena_mark {
+    struct arena_chunk *chunk;
+    size_t offset;
+    size_t in_use;
+};
+
+// Allocate size bytes aligned to align (a power of two)
+// Memory is not zeroed. Returns NULL if no memory could be obtained.
+void *arena_alloc(struct arena *a, size_t size, size_t align);
+
+// Like arena_alloc, but zero-filled
+void *arena_zalloc(struct arena *a, size_t size, size_t align);
+
+// Typed helpers: ARENA_NEW(a, Elf64_Ehdr), ARENA_ARRAY(a, Elf64_Phdr, n)
+// ARENA_ARRAY returns NULL if n * sizeof(type) overflows
+#define ARENA_NEW(a, type) \
+    ((type *)arena_alloc((a), sizeof(type), _Alignof(type)))
+#define ARENA_ARRAY(a, type, n) \
+    ((size_t)(n) > SIZE_MAX / sizeof(type) ? (type *)NULL : \
+     (type *)arena_alloc((a), (size_t)(n) * sizeof(type), _Alignof(type)))
+
+// Per-phase reset
+struct arena_mark arena_mark(const struct arena *a);
+void arena_reset(struct arena *a, struct arena_mark mark);
+
+// Return every mmap'd chunk to the kernel and drop the pages of the brk
+// chunk; the arena can be reused after
+void arena_release(struct arena *a);
+
+// Print high-water mark and syscall counts
+void arena_print_stats(const char *name, const struct arena *a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,20 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli) for segment integrity checks (crc32c.c), freestanding
+//
+// On CPUs with the ARMv8 CRC32 extension (HWCAP_CRC32) the buffer is split
+// into three streams fed to crc32cx in one loop, so the instruction's
+// latency overlaps, and the partial CRCs are merged by multiplying with a
+// fixed power of x mod the polynomial. Without it a byte table is used.
+
+// Continue crc over buf[0, len); crc32c(0, buf, len) is the usual CRC-32C
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+// "crc32cx" or "table", for the loader's stats
+const char *crc32c_impl(void);
+
+#endif /* CRC32C_H */
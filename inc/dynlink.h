@@ -0,0 +1,49 @@
+#ifndef DYNLINK_H
+#define DYNLINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "symbols.h"
+
+// Shared-library support (dynlink.c, dl_trampoline.S)
+//
+// After the main image is mapped and its relative relocations applied,
+// dynlink_load() maps its DT_NEEDED libraries (breadth first, each once),
+// applies their relative relocations, then resolves the symbol relocations
+// of every image against the global scope: the main image first, then the
+// libraries in load order. JUMP_SLOT relocations are bound lazily through
+// the PLT unless binding now was asked for, either by the image
+// (DF_BIND_NOW, DF_1_NOW) or by the loader (--bind-now).
+
+// Most images that dynlink_load() keeps track of, the main image included
+#define MAX_DSOS 64
+
+struct dynlink_config {
+    const char *library_path;    // colon-separated dirs searched first, or NULL
+    int bind_now;                // resolve every JUMP_SLOT before the jump
+    int trace;                   // report every lazy binding on stderr
+};
+
+struct dynlink_stats {
+    int libraries;               // DT_NEEDED images loaded
+    unsigned long symbolic;      // ABS64/GLOB_DAT/COPY relocations applied
+    unsigned long eager;         // JUMP_SLOTs resolved at load time
+    unsigned long lazy;          // JUMP_SLOTs pointed at the PLT resolver
+    unsigned long lazy_bound;    // of those, bound since the jump
+};
+
+extern struct dynlink_stats dynlink_stats;
+
+// Load the dependencies of main_image and apply all symbol relocations
+// Does nothing for images without a dynamic symbol table
+// Returns 0 on success, -1 (after printing why) on failure
+int dynlink_load(struct loaded_image *main_image, const struct dynlink_config *cfg);
+
+// Close the libraries' file views once nothing is left to bind lazily
+// (the mapped libraries themselves stay)
+void dynlink_release(void);
+
+// Print library and binding counts, if there was anything to bind
+void dynlink_print_stats(void);
+
+#endif /* DYNLINK_H */
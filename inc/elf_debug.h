@@ -12,9 +12,58 @@
 #endif
 
 // ELF file reading
+// read_elf_file maps the whole file read-only; release it with free_elf_file
 int read_elf_file(const char *path, void **out_data, size_t *out_size);
 void free_elf_file(void *data, size_t size);
 
+// A whole ELF file mapped read-only, with its header, program headers,
+// section headers and dynamic section bounds-checked once up front
+// Every pointer below lies entirely inside [data, data + size)
+struct elf_image {
+    const uint8_t *data;
+    size_t size;
+    int owns_data;               // unmapped by elf_image_close
+    const Elf64_Ehdr *ehdr;
+    const Elf64_Phdr *phdrs;     // NULL when phnum == 0
+    int phnum;                   // PN_XNUM is resolved through shdrs[0]
+    const Elf64_Shdr *shdrs;     // NULL when shnum == 0
+    int shnum;
+    const Elf64_Dyn *dynamic;    // file contents of PT_DYNAMIC, or NULL
+    size_t dynnum;               // entries up to and including DT_NULL
+};
+
+// Open and map path (openat, lseek, mmap, close)
+// Returns 0 on success, -1 if the file cannot be mapped or is malformed
+int elf_image_open(struct elf_image *img, const char *path);
+
+// Map an already open file; fd stays open and owned by the caller
+int elf_image_from_fd(struct elf_image *img, int fd);
+
+// Validate a buffer the caller owns
+int elf_image_from_memory(struct elf_image *img, const void *data, size_t size);
+
+// Validate just the ELF header and program headers at the start of a file
+// whose segment contents are kept elsewhere (LZ4 containers); shdrs and
+// dynamic are left NULL
+int elf_image_from_headers(struct elf_image *img, const void *data, size_t size);
+
+struct arena;
+
+// Read just the ELF header and program header table of path into memory
+// from a (no mapping, nothing to close) and validate them as
+// elf_image_from_headers does; size is the number of bytes read, not the
+// file size
+int elf_image_read_headers(struct elf_image *img, const char *path, struct arena *a);
+
+void elf_image_close(struct elf_image *img);
+
+// Bounds-checked view of [offset, offset + len) in the file, or NULL
+const void *elf_image_at(const struct elf_image *img, uint64_t offset, uint64_t len);
+
+// The NT_GNU_BUILD_ID note from a PT_NOTE segment
+// Returns 0 and points *id at the descriptor bytes, or -1 if there is none
+int elf_image_build_id(const struct elf_image *img, const uint8_t **id, size_t *len);
+
 // ELF header parsing
 int parse_elf_header(const void *data, size_t size, Elf64_Ehdr **out_ehdr);
 void print_elf_header(const Elf64_Ehdr *ehdr);
@@ -0,0 +1,50 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "elf_debug.h"
+
+// Shared image cache for --copy loads (image_cache.c)
+//
+// The read-only and executable PT_LOAD segments of an image are staged once,
+// page-aligned, in a tmpfs file named after the image's build-id (or, without
+// one, its device, inode, size and mtime). Later loads map those pages from
+// the entry instead of copying them, so every instance of the image shares
+// one physical copy; writable segments are still copied privately.
+//
+// An entry records the device, inode, size and mtime of the file it was
+// staged from. An entry found for a different file, or for one edited in
+// place since (the build-id stays the same), is dropped and staged again.
+//
+// Entries are written to a temporary name and renamed into place, so a
+// reader sees either nothing or a complete entry. They are created 0444 and
+// only used if they belong to this user and nobody else can write them.
+
+#define IMAGE_CACHE_DIR "/dev/shm"
+#define IMAGE_CACHE_KEY_MAX 96
+#define IMAGE_CACHE_MAX_SEGS 32
+
+struct image_cache {
+    int fd;                      // entry, or -1 if the image is not cached
+    int staged;                  // 1 if this load created the entry
+    char key[IMAGE_CACHE_KEY_MAX];
+    int nsegs;
+    struct {
+        int phdr;                // program header index
+        uint64_t offset;         // page-aligned offset of its pages in fd
+    } segs[IMAGE_CACHE_MAX_SEGS];
+};
+
+// Find the entry for img, staging it from img's file bytes if there is none
+// path is the file img was read from; the entry must have been staged from it
+// Returns 0 if c->fd can be mapped from, -1 if the image has to be copied
+int image_cache_open(struct image_cache *c, const struct elf_image *img,
+                     const char *path);
+
+// Offset in c->fd of program header index's pages, or -1 if not cached
+long image_cache_segment(const struct image_cache *c, int index);
+
+void image_cache_close(struct image_cache *c);
+
+#endif /* IMAGE_CACHE_H */
@@ -0,0 +1,32 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block format codec (lz4.c), freestanding
+//
+// A block is a run of sequences: a token (literal count << 4 | match
+// length - 4), the literals, a 16-bit little-endian match offset and the
+// match; lengths of 15 or more continue in extra bytes. The last sequence
+// holds only literals. There is no frame, checksum or dictionary: callers
+// store the compressed and raw sizes themselves.
+
+// Hash table entries lz4_compress() needs as scratch
+#define LZ4_HASH_BITS 16
+#define LZ4_HASH_SIZE (1U << LZ4_HASH_BITS)
+
+// Largest compressed size of len bytes
+#define LZ4_COMPRESS_BOUND(len) ((len) + (len) / 255 + 16)
+
+// Compress src[0, len) into dst; table holds LZ4_HASH_SIZE entries
+// Returns the compressed size, or 0 if it does not fit in cap
+size_t lz4_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                    uint32_t *table);
+
+// Decompress one block of src_len bytes into dst, which has room for
+// dst_len bytes; every read and write is bounds-checked
+// Returns the number of bytes written, or -1 if the block is malformed
+long lz4_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len);
+
+#endif /* LZ4_H */
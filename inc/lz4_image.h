@@ -0,0 +1,60 @@
+#ifndef LZ4_IMAGE_H
+#define LZ4_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "elf_debug.h"
+
+// LZ4-compressed ELF container (lz4_image.c; written by pack_lz4)
+//
+//   struct lz4_image_header
+//   struct lz4_image_segment[nsegs]   one per PT_LOAD with file bytes
+//   bytes [0, headers_size) of the original file: ELF header and phdrs
+//   one LZ4 block (lz4.h) per segment, holding its p_filesz file bytes
+//
+// The loader decompresses each block straight into the segment's final
+// memory. Everything else in the original file (section headers, .symtab)
+// is dropped, so symbol lookup only sees the dynamic symbol table.
+
+#define LZ4_IMAGE_MAGIC "MLLZ4IMG"
+#define LZ4_IMAGE_VERSION 1
+
+struct lz4_image_header {
+    char magic[8];               // LZ4_IMAGE_MAGIC, not NUL-terminated
+    uint32_t version;
+    uint32_t nsegs;
+    uint64_t elf_size;           // size of the original file
+    uint64_t headers_offset;
+    uint64_t headers_size;
+};
+
+struct lz4_image_segment {
+    uint32_t phdr;               // program header index
+    uint32_t reserved;
+    uint64_t offset;             // LZ4 block in the container
+    uint64_t size;               // compressed size
+    uint64_t raw_size;           // p_filesz
+};
+
+// A container held in memory, checked by lz4_image_open()
+struct lz4_image {
+    const uint8_t *data;
+    size_t size;
+    const struct lz4_image_segment *segs;
+    uint32_t nsegs;
+    uint64_t elf_size;
+    struct elf_image elf;        // headers only (elf_image_from_headers)
+};
+
+// Whether data starts with LZ4_IMAGE_MAGIC
+int lz4_image_detect(const void *data, size_t size);
+
+// Check the header, the segment table (every block inside the container,
+// exactly one per PT_LOAD with file bytes) and the ELF headers
+// Returns 0 on success, -1 if the container is malformed
+int lz4_image_open(struct lz4_image *c, const void *data, size_t size);
+
+// The block for program header index, or NULL if it has none
+const struct lz4_image_segment *lz4_image_segment(const struct lz4_image *c, int index);
+
+#endif /* LZ4_IMAGE_H */
@@ -3,6 +3,46 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "arena.h"
+#include "reloc.h"
+#include "symbols.h"
+
+// How PT_LOAD contents are brought into the reserved region
+#define LOAD_MODE_COPY 0   // read the whole file, memcpy each segment
+#define LOAD_MODE_MMAP 1   // map each segment straight from the file
+#define LOAD_MODE_STREAM 2 // one forward pass over a pipe or file, no seeking
+
+// Byte counters for the last load, reported by load_elf_from_path()
+struct load_stats {
+    size_t file_size;      // size of the ELF file on disk
+    size_t bytes_read;     // bytes pulled in with sys_read
+    size_t bytes_copied;   // bytes memcpy'd into segment memory
+    size_t bytes_zeroed;   // BSS bytes cleared by hand
+    size_t bytes_mapped;   // bytes mapped directly from the file
+    size_t bytes_skipped;  // stream bytes read and discarded between segments
+    size_t bytes_shared;   // bytes mapped from the shared image cache (--cache)
+    size_t lz4_packed;     // LZ4 container: compressed bytes decompressed
+    size_t lz4_unpacked;   // and the segment bytes they produced
+    uint64_t lz4_ns;       // time spent decompressing
+    int verified;          // PT_LOADs checked against their CRC-32C
+    size_t verify_bytes;   // bytes those checks covered
+    uint64_t verify_ns;    // time spent checking
+    int threads;           // threads that populated segments
+    int huge_segments;     // segments advised MADV_HUGEPAGE (--huge)
+    size_t huge_bytes;     // bytes covered by those advice calls
+    long minor_faults;     // page faults taken while loading (getrusage)
+    long major_faults;
+    struct reloc_stats reloc;
+};
+
+extern struct load_stats loader_stats;
+
+// The image placed by the last successful map_elf()/map_elf_from_fd(), for
+// loader_lookup_symbol()
+extern struct loaded_image loader_image;
+
+// Scratch memory for a load: the file buffer, program header copies, ...
+extern struct arena loader_arena;
 
 // Read an entire file into memory
 // Returns pointer to file contents, sets *size to file size in bytes
@@ -13,8 +53,41 @@ void *read_file_into_memory(const char *path, size_t *size);
 // Returns entry point address, or 0 on failure
 uintptr_t map_elf(void *elf_data, size_t size);
 
-// Load and execute an ELF file from path
+// Map ELF segments by mmap'ing them from an open file descriptor
+// Only the partial BSS page is zeroed by hand
+// Returns entry point address, or 0 on failure
+uintptr_t map_elf_from_fd(int fd);
+
+// Load from a pipe or any other fd that is read strictly forward: the
+// headers, then each PT_LOAD in file order straight into its memory
+// Returns entry point address, or 0 on failure
+uintptr_t map_elf_stream(int fd);
+
+// map_elf_from_fd() for any image: records it in *image instead of
+// loader_image (used for shared libraries)
+uintptr_t map_elf_image_from_fd(int fd, struct loaded_image *image);
+
+// Map an ELF file with the selected load mode without running it
+// Returns entry point address, or 0 on failure
+uintptr_t load_image(const char *path);
+
+// Size of the stack start_program() hands to the loaded program
+#define PROGRAM_STACK_SIZE (8UL << 20)
+
+// Switch to a fresh stack laid out like the kernel's initial process stack
+// (argc, argv, envp, auxv) and jump to entry. Never returns.
+// auxv describes the image in loader_image (AT_PHDR, AT_ENTRY, ...) and
+// forwards the loader's AT_HWCAP/AT_HWCAP2/AT_SYSINFO_EHDR and credentials
+void start_program(uintptr_t entry, int argc, char **argv, char **envp)
+    __attribute__((noreturn));
+
+// Fork-server mode: map path once, then fork a pre-mapped child for every
+// request line read from stdin (see loader_server.c)
+// Returns the exit status for mini_loader
+int run_server(const char *path, char **envp);
+
+// Load and execute the ELF file argv[0], passing it argc/argv
 // This function should not return (it jumps to the loaded program)
-void load_elf_from_path(const char *path);
+void load_elf_from_path(int argc, char **argv);
 
 #endif /* MINI_LOADER_H */
@@ -0,0 +1,27 @@
+#ifndef RELOC_H
+#define RELOC_H
+
+#include <stdint.h>
+#include "elf_format.h"
+
+// Relocation counters for one image
+struct reloc_stats {
+    unsigned long rela;         // R_AARCH64_RELATIVE entries from DT_RELA
+    unsigned long relr;         // addresses relocated from DT_RELR
+    unsigned long unchanged;    // targets that already held the right value
+    unsigned long symbolic;     // symbol relocations, left to dynlink.c
+    unsigned long unsupported;  // entries of any other type (skipped)
+    unsigned long pages;        // distinct pages written, in table order
+    uint64_t ns;                // time spent in relocate_image()
+};
+
+// Apply the relative relocations of a mapped static-PIE
+// Walks DT_RELA/DT_RELASZ and the packed DT_RELR bitmap format from the
+// image's PT_DYNAMIC. Only pages holding a target that actually changes are
+// written; segments without PF_W are made writable only while they are
+// being relocated and get their original protection back afterwards.
+// Returns 0 on success, -1 if a table or target lies outside the image
+int relocate_image(const Elf64_Phdr *phdrs, int phnum, uintptr_t load_bias,
+                   struct reloc_stats *stats);
+
+#endif /* RELOC_H */
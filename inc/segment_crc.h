@@ -0,0 +1,57 @@
+#ifndef SEGMENT_CRC_H
+#define SEGMENT_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "elf_debug.h"
+
+// Per-segment CRC-32C checksums that mini_loader verifies before running an
+// image (segment_crc.c); stamp_crc writes them
+//
+// The checksums are an ELF note: name "MLCRC", type NT_SEGMENT_CRC and a
+// descriptor of { version, count } followed by count { phdr index, crc }
+// pairs. Each crc covers the p_filesz file bytes of that PT_LOAD, after the
+// note's own program header was filled in.
+//
+// stamp_crc appends the note to the file and points a spare PT_NULL
+// program header at it as a PT_NOTE with p_memsz 0, so it is never loaded.
+// Images without a spare header get the same note in a sidecar file,
+// <path>.crc.
+
+#define SEGMENT_CRC_NAME "MLCRC"
+#define NT_SEGMENT_CRC 0x4352434dU   // "MCRC"
+#define SEGMENT_CRC_VERSION 1
+#define SEGMENT_CRC_MAX 64
+#define SEGMENT_CRC_SUFFIX ".crc"
+
+struct segment_crc {
+    int count;
+    struct {
+        uint32_t phdr;               // program header index of a PT_LOAD
+        uint32_t crc;
+    } segs[SEGMENT_CRC_MAX];
+};
+
+// Bytes of the note holding count checksums
+size_t segment_crc_note_size(int count);
+
+// Write sums as a complete note (segment_crc_note_size(sums->count) bytes)
+void segment_crc_write_note(const struct segment_crc *sums, void *buf);
+
+// Parse note bytes (PT_NOTE contents or a sidecar file)
+// Returns 0 if they hold a checksum note, -1 otherwise
+int segment_crc_parse(const void *data, size_t len, struct segment_crc *sums);
+
+// Index of the unloaded PT_NOTE a stamped image carries its note in, or -1
+// Only the program headers are looked at
+int segment_crc_phdr(const struct elf_image *img);
+
+// Checksums from the note in img's file bytes
+// Returns 0 on success, -1 if there is no note or img does not hold it
+int segment_crc_from_image(const struct elf_image *img, struct segment_crc *sums);
+
+// Checksums from path's sidecar file
+// Returns 0 on success, -1 if there is none or it is malformed
+int segment_crc_from_sidecar(const char *path, struct segment_crc *sums);
+
+#endif /* SEGMENT_CRC_H */
@@ -0,0 +1,66 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "elf_debug.h"
+
+// Symbol lookup in an image placed by map_elf() or map_elf_from_fd()
+//
+// Dynamic symbols are found through DT_GNU_HASH (bloom filter, then a
+// single bucket chain) or, failing that, DT_HASH, reading the tables from
+// the mapped image. Most static-PIEs export nothing, so names missing from
+// the dynamic table are looked up in the file's .symtab, which is sorted by
+// name once on first use and binary searched after that.
+struct loaded_image {
+    uintptr_t load_bias;
+    const Elf64_Phdr *phdrs;     // inside file
+    int phnum;
+    struct elf_image file;       // file view; closed by loaded_image_close
+    struct arena *arena;         // holds the .symtab index
+
+    // Dynamic symbol table in the mapped image; dynsym is NULL if the image
+    // has none or its tables failed the bounds checks
+    const Elf64_Sym *dynsym;
+    const char *dynstr;
+    size_t dynstr_size;
+    uint32_t dynsym_count;
+    const uint32_t *gnu_hash;    // DT_GNU_HASH, or NULL
+    const uint32_t *sysv_hash;   // DT_HASH, or NULL
+
+    // .symtab index: defined symbols sorted by name, globals first
+    int symtab_state;            // 0 not built yet, 1 built, -1 unavailable
+    const Elf64_Sym *symtab;
+    const char *strtab;
+    uint32_t *sorted;
+    uint32_t sorted_count;
+};
+
+// Describe an image mapped at load_bias; takes over file (whose phdrs and
+// dynamic section must still be valid) and finds the dynamic symbol tables
+void loaded_image_init(struct loaded_image *li, const struct elf_image *file,
+                       uintptr_t load_bias, struct arena *arena);
+void loaded_image_close(struct loaded_image *li);
+
+// Pointer to the run-time copy of link-time range [vaddr, vaddr + len), or
+// NULL unless it lies inside one readable PT_LOAD
+const void *loaded_image_at(const struct loaded_image *li, uint64_t vaddr,
+                            uint64_t len);
+
+// The defined, exported dynamic symbol called name, or NULL
+// This is the lookup the dynamic linker uses: .symtab is not consulted
+const Elf64_Sym *loader_find_dynsym(const struct loaded_image *li, const char *name);
+
+// Run-time address of a symbol of li (SHN_ABS values are not biased)
+uintptr_t loader_symbol_address(const struct loaded_image *li, const Elf64_Sym *sym);
+
+// Run-time address of the defined symbol name, or 0 if there is none
+uintptr_t loader_lookup_symbol(struct loaded_image *li, const char *name);
+
+// Look up count names at once; addrs[i] is 0 for names that were not found
+// Returns the number of names found
+size_t loader_lookup_symbols(struct loaded_image *li, const char *const *names,
+                             size_t count, uintptr_t *addrs);
+
+#endif /* SYMBOLS_H */
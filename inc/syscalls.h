@@ -1,17 +1,38 @@
 #ifndef SYSCALLS_H
 #define SYSCALLS_H
 
+#include <stdint.h>
+
 // aarch64 Linux syscall numbers
 #define SYS_read 63
 #define SYS_write 64
+#define SYS_writev 66
 #define SYS_openat 56
 #define SYS_close 57
 #define SYS_lseek 62
+#define SYS_ftruncate 46
 #define SYS_mmap 222
 #define SYS_munmap 215
 #define SYS_mprotect 226
+#define SYS_madvise 233
+#define SYS_getrusage 165
 #define SYS_brk 214
 #define SYS_exit 93
+#define SYS_clock_gettime 113
+#define SYS_dup3 24
+#define SYS_clone 220
+#define SYS_wait4 260
+#define SYS_execve 221
+#define SYS_futex 98
+#define SYS_getpid 172
+#define SYS_process_vm_readv 270
+#define SYS_newfstatat 79
+#define SYS_fstat 80
+#define SYS_getuid 174
+#define SYS_renameat2 276
+#define SYS_unlinkat 35
+#define SYS_io_uring_setup 425
+#define SYS_io_uring_enter 426
 
 // AT_FDCWD for openat
 #define AT_FDCWD -100
@@ -20,6 +41,9 @@
 #define O_RDONLY 0
 #define O_WRONLY 1
 #define O_RDWR 2
+#define O_CREAT 0100
+#define O_EXCL 0200
+#define O_TRUNC 01000
 
 // SEEK flags
 #define SEEK_SET 0
@@ -36,11 +60,200 @@
 #define MAP_PRIVATE 0x02
 #define MAP_ANONYMOUS 0x20
 #define MAP_FIXED 0x10
+#define MAP_NORESERVE 0x4000
+#define MAP_POPULATE 0x8000
 
 #define MAP_FAILED ((void *) -1)
 
+// madvise advice
+#define MADV_WILLNEED 3
+#define MADV_DONTNEED 4
+#define MADV_HUGEPAGE 14
+#define MADV_POPULATE_WRITE 23
+
+// Scatter/gather element for writev
+struct iovec {
+    void *iov_base;
+    unsigned long iov_len;
+};
+
+// Signal sent to the parent when a forked child exits
+#define SIGCHLD 17
+
+// clone flags for threads that share the whole process
+#define CLONE_VM 0x00000100
+#define CLONE_FS 0x00000200
+#define CLONE_FILES 0x00000400
+#define CLONE_SIGHAND 0x00000800
+#define CLONE_THREAD 0x00010000
+#define CLONE_SYSVSEM 0x00040000
+#define CLONE_PARENT_SETTID 0x00100000
+#define CLONE_CHILD_CLEARTID 0x00200000
+
+// futex operations
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_PRIVATE_FLAG 128
+
+// Resource usage, as filled in by getrusage and wait4
+#define RUSAGE_SELF 0
+
+struct timeval {
+    long tv_sec;
+    long tv_usec;
+};
+
+struct rusage {
+    struct timeval ru_utime;
+    struct timeval ru_stime;
+    long ru_maxrss;
+    long ru_ixrss;
+    long ru_idrss;
+    long ru_isrss;
+    long ru_minflt;
+    long ru_majflt;
+    long ru_nswap;
+    long ru_inblock;
+    long ru_oublock;
+    long ru_msgsnd;
+    long ru_msgrcv;
+    long ru_nsignals;
+    long ru_nvcsw;
+    long ru_nivcsw;
+};
+
+// File status from fstat/fstatat (the generic layout arm64 uses)
+struct stat {
+    unsigned long st_dev;
+    unsigned long st_ino;
+    unsigned int st_mode;
+    unsigned int st_nlink;
+    unsigned int st_uid;
+    unsigned int st_gid;
+    unsigned long st_rdev;
+    unsigned long __pad1;
+    long st_size;
+    int st_blksize;
+    int __pad2;
+    long st_blocks;
+    long st_atime;
+    unsigned long st_atime_nsec;
+    long st_mtime;
+    unsigned long st_mtime_nsec;
+    long st_ctime;
+    unsigned long st_ctime_nsec;
+    unsigned int __unused4;
+    unsigned int __unused5;
+};
+
+// io_uring: ring offsets filled in by io_uring_setup, then mmap'd from the
+// ring fd at the IORING_OFF_* offsets
+struct io_sqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t flags;
+    uint32_t dropped;
+    uint32_t array;
+    uint32_t resv1;
+    uint64_t user_addr;
+};
+
+struct io_cqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t overflow;
+    uint32_t cqes;
+    uint32_t flags;
+    uint32_t resv1;
+    uint64_t user_addr;
+};
+
+struct io_uring_params {
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t flags;
+    uint32_t sq_thread_cpu;
+    uint32_t sq_thread_idle;
+    uint32_t features;
+    uint32_t wq_fd;
+    uint32_t resv[3];
+    struct io_sqring_offsets sq_off;
+    struct io_cqring_offsets cq_off;
+};
+
+// Submission queue entry (64 bytes); only the fields the tools use are named
+struct io_uring_sqe {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t ioprio;
+    int32_t fd;
+    uint64_t off;
+    uint64_t addr;                // buffer, or path for OPENAT
+    uint32_t len;                 // byte count, or mode for OPENAT
+    uint32_t op_flags;            // open flags for OPENAT, rw flags for READ
+    uint64_t user_data;
+    uint16_t buf_index;
+    uint16_t personality;
+    int32_t splice_fd_in;
+    uint64_t addr3;
+    uint64_t pad2;
+};
+
+// Completion queue entry; res is the syscall-style result (fd, bytes, -errno)
+struct io_uring_cqe {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+};
+
+#define IORING_OP_OPENAT 18
+#define IORING_OP_CLOSE 19
+#define IORING_OP_READ 22
+
+#define IORING_OFF_SQ_RING 0ULL
+#define IORING_OFF_CQ_RING 0x8000000ULL
+#define IORING_OFF_SQES 0x10000000ULL
+
+#define IORING_ENTER_GETEVENTS 1U
+#define IORING_FEAT_SINGLE_MMAP 1U
+
+// clock_gettime clocks
+#define CLOCK_MONOTONIC 1
+
+struct timespec {
+    long tv_sec;
+    long tv_nsec;
+};
+
+// make STATS=1 (SYSCALL_STATS): every syscall below is counted with its
+// cost in cntvct_el0 ticks and, for reads/writes and mappings, the bytes it
+// moved; syscall_stats.c prints the table at exit. Default builds compile
+// the hooks to nothing.
+#ifdef SYSCALL_STATS
+void syscall_account(long n, long ret, long len, uint64_t start);
+void syscall_stats_dump(void);
+
+static inline uint64_t syscall_ticks(void) {
+    uint64_t ticks;
+    __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0" : "=r"(ticks) : : "memory");
+    return ticks;
+}
+
+#define SYSCALL_STATS_BEGIN() uint64_t syscall_start = syscall_ticks()
+#define SYSCALL_STATS_END(n, ret, len) syscall_account((n), (ret), (len), syscall_start)
+#else
+#define SYSCALL_STATS_BEGIN() ((void)0)
+#define SYSCALL_STATS_END(n, ret, len) ((void)0)
+#define syscall_stats_dump() ((void)0)
+#endif
+
 // Generic syscall wrappers using inline assembly
 static inline long syscall0(long n) {
+    SYSCALL_STATS_BEGIN();
     register long x8 __asm__("x8") = n;
     register long x0 __asm__("x0");
     __asm__ __volatile__(
@@ -49,10 +262,12 @@ static inline long syscall0(long n) {
         : "r"(x8)
         : "memory"
     );
+    SYSCALL_STATS_END(n, x0, 0);
     return x0;
 }
 
 static inline long syscall1(long n, long a0) {
+    SYSCALL_STATS_BEGIN();
     register long x8 __asm__("x8") = n;
     register long x0 __asm__("x0") = a0;
     __asm__ __volatile__(
@@ -61,10 +276,12 @@ static inline long syscall1(long n, long a0) {
         : "r"(x8)
         : "memory"
     );
+    SYSCALL_STATS_END(n, x0, 0);
     return x0;
 }
 
 static inline long syscall2(long n, long a0, long a1) {
+    SYSCALL_STATS_BEGIN();
     register long x8 __asm__("x8") = n;
     register long x0 __asm__("x0") = a0;
     register long x1 __asm__("x1") = a1;
@@ -74,10 +291,12 @@ static inline long syscall2(long n, long a0, long a1) {
         : "r"(x8), "r"(x1)
         : "memory"
     );
+    SYSCALL_STATS_END(n, x0, a1);
     return x0;
 }
 
 static inline long syscall3(long n, long a0, long a1, long a2) {
+    SYSCALL_STATS_BEGIN();
     register long x8 __asm__("x8") = n;
     register long x0 __asm__("x0") = a0;
     register long x1 __asm__("x1") = a1;
@@ -88,10 +307,12 @@ static inline long syscall3(long n, long a0, long a1, long a2) {
         : "r"(x8), "r"(x1), "r"(x2)
         : "memory"
     );
+    SYSCALL_STATS_END(n, x0, a1);
     return x0;
 }
 
 static inline long syscall4(long n, long a0, long a1, long a2, long a3) {
+    SYSCALL_STATS_BEGIN();
     register long x8 __asm__("x8") = n;
     register long x0 __asm__("x0") = a0;
     register long x1 __asm__("x1") = a1;
@@ -103,10 +324,12 @@ static inline long syscall4(long n, long a0, long a1, long a2, long a3) {
         : "r"(x8), "r"(x1), "r"(x2), "r"(x3)
         : "memory"
     );
+    SYSCALL_STATS_END(n, x0, a1);
     return x0;
 }
 
 static inline long syscall5(long n, long a0, long a1, long a2, long a3, long a4) {
+    SYSCALL_STATS_BEGIN();
     register long x8 __asm__("x8") = n;
     register long x0 __asm__("x0") = a0;
     register long x1 __asm__("x1") = a1;
@@ -119,10 +342,12 @@ static inline long syscall5(long n, long a0, long a1, long a2, long a3, long a4)
         : "r"(x8), "r"(x1), "r"(x2), "r"(x3), "r"(x4)
         : "memory"
     );
+    SYSCALL_STATS_END(n, x0, a1);
     return x0;
 }
 
 static inline long syscall6(long n, long a0, long a1, long a2, long a3, long a4, long a5) {
+    SYSCALL_STATS_BEGIN();
     register long x8 __asm__("x8") = n;
     register long x0 __asm__("x0") = a0;
     register long x1 __asm__("x1") = a1;
@@ -136,6 +361,7 @@ static inline long syscall6(long n, long a0, long a1, long a2, long a3, long a4,
         : "r"(x8), "r"(x1), "r"(x2), "r"(x3), "r"(x4), "r"(x5)
         : "memory"
     );
+    SYSCALL_STATS_END(n, x0, a1);
     return x0;
 }
 
@@ -148,10 +374,19 @@ static inline long sys_write(int fd, const void *buf, unsigned long count) {
     return syscall3(SYS_write, fd, (long)buf, count);
 }
 
+static inline long sys_writev(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_writev, fd, (long)iov, iovcnt);
+}
+
 static inline long sys_openat(int dirfd, const char *pathname, int flags) {
     return syscall3(SYS_openat, dirfd, (long)pathname, flags);
 }
 
+// openat with a mode for O_CREAT
+static inline long sys_openat_mode(int dirfd, const char *pathname, int flags, int mode) {
+    return syscall4(SYS_openat, dirfd, (long)pathname, flags, mode);
+}
+
 static inline long sys_close(int fd) {
     return syscall1(SYS_close, fd);
 }
@@ -160,6 +395,10 @@ static inline long sys_lseek(int fd, long offset, int whence) {
     return syscall3(SYS_lseek, fd, offset, whence);
 }
 
+static inline long sys_ftruncate(int fd, long length) {
+    return syscall2(SYS_ftruncate, fd, length);
+}
+
 static inline void *sys_mmap(void *addr, unsigned long length, int prot, int flags, int fd, long offset) {
     return (void *)syscall6(SYS_mmap, (long)addr, length, prot, flags, fd, offset);
 }
@@ -172,11 +411,92 @@ static inline long sys_mprotect(void *addr, unsigned long len, int prot) {
     return syscall3(SYS_mprotect, (long)addr, len, prot);
 }
 
+static inline long sys_madvise(void *addr, unsigned long len, int advice) {
+    return syscall3(SYS_madvise, (long)addr, len, advice);
+}
+
 static inline void *sys_brk(void *addr) {
     return (void *)syscall1(SYS_brk, (long)addr);
 }
 
+static inline long sys_clock_gettime(int clock_id, struct timespec *ts) {
+    return syscall2(SYS_clock_gettime, clock_id, (long)ts);
+}
+
+static inline long sys_dup3(int oldfd, int newfd, int flags) {
+    return syscall3(SYS_dup3, oldfd, newfd, flags);
+}
+
+// fork() is clone(SIGCHLD) with no new stack: returns 0 in the child
+static inline long sys_fork(void) {
+    return syscall5(SYS_clone, SIGCHLD, 0, 0, 0, 0);
+}
+
+static inline long sys_execve(const char *path, char *const argv[], char *const envp[]) {
+    return syscall3(SYS_execve, (long)path, (long)argv, (long)envp);
+}
+
+static inline long sys_wait4(int pid, int *status, int options, void *rusage) {
+    return syscall4(SYS_wait4, pid, (long)status, options, (long)rusage);
+}
+
+static inline long sys_futex(uint32_t *uaddr, int op, uint32_t val) {
+    return syscall4(SYS_futex, (long)uaddr, op, val, 0);
+}
+
+static inline long sys_getpid(void) {
+    return syscall0(SYS_getpid);
+}
+
+// Copy from another process (or this one) without risking a fault: an
+// unmapped or unreadable remote range just ends the transfer early
+// Returns the number of bytes read, or a negative error
+static inline long sys_process_vm_readv(int pid, const struct iovec *local, unsigned long liovcnt,
+                                        const struct iovec *remote, unsigned long riovcnt) {
+    return syscall6(SYS_process_vm_readv, pid, (long)local, liovcnt, (long)remote, riovcnt, 0);
+}
+
+static inline long sys_fstat(int fd, struct stat *st) {
+    return syscall2(SYS_fstat, fd, (long)st);
+}
+
+static inline long sys_fstatat(int dirfd, const char *path, struct stat *st, int flags) {
+    return syscall4(SYS_newfstatat, dirfd, (long)path, (long)st, flags);
+}
+
+static inline long sys_getuid(void) {
+    return syscall0(SYS_getuid);
+}
+
+// rename with no flags; replaces newpath atomically
+static inline long sys_renameat(int olddirfd, const char *oldpath,
+                                int newdirfd, const char *newpath) {
+    return syscall5(SYS_renameat2, olddirfd, (long)oldpath, newdirfd, (long)newpath, 0);
+}
+
+static inline long sys_unlinkat(int dirfd, const char *path, int flags) {
+    return syscall3(SYS_unlinkat, dirfd, (long)path, flags);
+}
+
+// Returns the ring fd, or a negative error (-ENOSYS on old kernels, -EPERM
+// where io_uring is disabled)
+static inline long sys_io_uring_setup(unsigned int entries, struct io_uring_params *p) {
+    return syscall2(SYS_io_uring_setup, entries, (long)p);
+}
+
+// Submit to_submit SQEs and, with IORING_ENTER_GETEVENTS, wait until at
+// least min_complete CQEs are ready; returns the number submitted
+static inline long sys_io_uring_enter(int fd, unsigned int to_submit,
+                                      unsigned int min_complete, unsigned int flags) {
+    return syscall6(SYS_io_uring_enter, fd, to_submit, min_complete, flags, 0, 0);
+}
+
+static inline long sys_getrusage(int who, struct rusage *usage) {
+    return syscall2(SYS_getrusage, who, (long)usage);
+}
+
 static inline void sys_exit(int status) {
+    syscall_stats_dump();
     syscall1(SYS_exit, status);
     __builtin_unreachable();
 }
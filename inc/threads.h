@@ -0,0 +1,28 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stddef.h>
+
+// Tiny freestanding thread pool built on clone + futex
+//
+// There is a single process-wide pool. Workers sleep on a futex until
+// thread_pool_run() posts a job, then claim indices 0..count-1 one at a
+// time; the calling thread works on the job too and returns once every
+// index has been processed.
+
+#define THREAD_POOL_MAX 64
+
+// Start nthreads - 1 workers (the caller counts as one thread)
+// Returns the number of threads actually available, at least 1
+int thread_pool_init(int nthreads);
+
+// Number of threads taking part in thread_pool_run(), including the caller
+int thread_pool_size(void);
+
+// Call fn(arg, i) for every i in [0, count) across the pool and wait
+void thread_pool_run(void (*fn)(void *arg, size_t index), void *arg, size_t count);
+
+// Stop and join all workers and release their stacks
+void thread_pool_shutdown(void);
+
+#endif /* THREADS_H */
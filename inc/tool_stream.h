@@ -0,0 +1,57 @@
+#ifndef TOOL_STREAM_H
+#define TOOL_STREAM_H
+
+#include <stddef.h>
+
+// Multi-file streaming for the debug tools (tool_stream.c)
+//
+//   tool [--json|--tsv] <file>...
+//   tool [--json|--tsv] -0 < list      (NUL-separated paths on stdin)
+//
+// In --json and --tsv mode every file produces one record, built in
+// memory and written with a single write(2). A write to a pipe is only
+// atomic up to PIPE_BUF (4096 bytes), so records from parallel runs
+// sharing a pipe stay whole only while they are that short; larger ones
+// (files with many program headers) can interleave.
+
+#define OUTPUT_HUMAN 0   // the tool's normal table
+#define OUTPUT_JSON 1    // one JSON object per line
+#define OUTPUT_TSV 2     // tab-separated rows; each row starts with the path
+
+struct tool_options {
+    int format;          // OUTPUT_*
+    int from_stdin;      // read NUL-separated paths from stdin
+    int first_path;      // index of the first path in argv
+    int many;            // more than one path: human output gets "File:" lines
+};
+
+// Parse the shared options; returns -1 (after printing usage) on error
+int tool_parse_args(int argc, char **argv, struct tool_options *opts);
+
+// Call fn for every path; returns the number of calls that returned < 0
+int tool_for_each_path(int argc, char **argv, const struct tool_options *opts,
+                       int (*fn)(const char *path, void *arg), void *arg);
+
+// Largest record a tool can emit; longer records are replaced by an error
+#define RECORD_MAX (256UL << 10)
+
+struct record {
+    size_t len;
+    int overflow;
+    char buf[RECORD_MAX];
+};
+
+void record_reset(struct record *r);
+void record_printf(struct record *r, const char *fmt, ...);
+// s as a quoted JSON string
+void record_json_string(struct record *r, const char *s);
+// s as a TSV field: tab, newline and backslash are escaped
+void record_tsv_field(struct record *r, const char *s);
+// Write the record to stdout in one write(2) and reset it
+// Returns 0 on success, -1 if the record overflowed or the write failed
+int record_emit(struct record *r);
+
+// Emit {"path": ..., "error": msg} in JSON mode; otherwise report on stderr
+void record_error(struct record *r, int format, const char *path, const char *msg);
+
+#endif /* TOOL_STREAM_H */
@@ -2,18 +2,52 @@
 #define UTILS_H
 
 #include <stdint.h>
+#include <stdarg.h>
 #include <stddef.h>
 
 // String and memory utilities
 void *memcpy(void *dest, const void *src, size_t n);
 void *memset(void *s, int c, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
 char *strcpy(char *dest, const char *src);
 size_t strlen(const char *s);
+int strcmp(const char *a, const char *b);
+
+// Auxiliary vector access; _start calls auxv_init(envp) before main
+void auxv_init(char **envp);
+// Value of the given AT_* entry, or 0 if the kernel did not pass it
+unsigned long auxv_get(unsigned long type);
+// System page size from AT_PAGESZ (0x1000 if it is missing)
+unsigned long page_size(void);
+
+// Parse an unsigned decimal number; returns 0 if s is not one
+unsigned long parse_uint(const char *s);
+
+// Monotonic clock in nanoseconds
+uint64_t monotonic_ns(void);
 
 // Mini printf with limited format specifiers
-// Supports: %s, %d, %x, %p, %%
+// Supports: %s, %c, %d, %u, %x, %p, %%, the 'l' length modifier and a
+// field width with '-' / '0' flags (e.g. %016lx, %-10s)
+// Output is buffered; see output_flush()
 void mini_printf(const char *fmt, ...);
 
+// Same formatting as mini_printf, into buf (always NUL-terminated)
+// Output that does not fit is dropped; returns the number of characters
+// stored, not counting the NUL
+int mini_snprintf(char *buf, size_t size, const char *fmt, ...);
+int mini_vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+
+// Same formatting as mini_printf, written to stderr with a single write per
+// call (lines longer than the 4 KiB buffer are split)
+void mini_eprintf(const char *fmt, ...);
+
+// Write out everything mini_printf has buffered so far
+// Called automatically by _start when main returns; call it yourself
+// before exiting any other way or handing control to another program
+void output_flush(void);
+
 // Hex dump utility for debugging
 void print_hex_dump(const void *data, size_t size);
 
@@ -0,0 +1,163 @@
+#include "arena.h"
+#include "syscalls.h"
+#include "utils.h"
+
+#define PAGE_SIZE page_size()
+#define PAGE_ALIGN_UP(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((uintptr_t)(a) - 1))
+
+// Header at the start of every chunk
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;      // whole chunk, header included
+    int from_brk;     // brk chunks cannot be unmapped
+};
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(struct arena_chunk), 16)
+
+// Try to grow the program break by size bytes
+static void *chunk_from_brk(struct arena *a, size_t size) {
+    uintptr_t cur = (uintptr_t)sys_brk(NULL);
+    a->stats.brk_calls++;
+    if (cur == 0) {
+        return NULL;
+    }
+
+    uintptr_t start = PAGE_ALIGN_UP(cur);
+    uintptr_t end = start + size;
+    a->stats.brk_calls++;
+    if ((uintptr_t)sys_brk((void *)end) != end) {
+        return NULL;
+    }
+    return (void *)start;
+}
+
+// Get a new chunk able to hold need bytes after the header
+static struct arena_chunk *new_chunk(struct arena *a, size_t need) {
+    size_t size = PAGE_ALIGN_UP(CHUNK_HEADER + need);
+    if (size < ARENA_CHUNK_SIZE) {
+        size = ARENA_CHUNK_SIZE;
+    }
+
+    // The first chunk comes from brk when possible; after that, or if the
+    // break cannot move, use one large mmap that is only touched lazily
+    struct arena_chunk *chunk = NULL;
+    int from_brk = 0;
+    if (!a->head) {
+        chunk = chunk_from_brk(a, size);
+        from_brk = chunk != NULL;
+    }
+    if (!chunk) {
+        chunk = sys_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        a->stats.mmap_calls++;
+        if (chunk == MAP_FAILED) {
+            return NULL;
+        }
+    }
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->from_brk = from_brk;
+    a->stats.reserved += size;
+    return chunk;
+}
+
+void *arena_alloc(struct arena *a, size_t size, size_t align) {
+    if (align < 16) {
+        align = 16;
+    }
+    if (size > SIZE_MAX - CHUNK_HEADER - align) {
+        return NULL;
+    }
+
+    for (;;) {
+        if (a->cur) {
+            size_t start = ALIGN_UP(a->offset, align);
+            if (start <= a->cur->size && a->cur->size - start >= size) {
+                a->stats.in_use += start + size - a->offset;
+                if (a->stats.in_use > a->stats.high_water) {
+                    a->stats.high_water = a->stats.in_use;
+                }
+                a->offset = start + size;
+                return (uint8_t *)a->cur + start;
+            }
+        }
+
+        // Move on to the next chunk: one kept from before a reset, or a new one
+        struct arena_chunk *next = a->cur ? a->cur->next : a->head;
+        if (next && next->size - CHUNK_HEADER < size + align) {
+            // Too small for this request: link a new chunk in front of it
+            next = NULL;
+        }
+        if (!next) {
+            next = new_chunk(a, size + align);
+            if (!next) {
+                return NULL;
+            }
+            if (a->cur) {
+                next->next = a->cur->next;
+                a->cur->next = next;
+            } else {
+                next->next = a->head;
+                a->head = next;
+            }
+        }
+
+        a->cur = next;
+        a->offset = CHUNK_HEADER;
+    }
+}
+
+void *arena_zalloc(struct arena *a, size_t size, size_t align) {
+    void *p = arena_alloc(a, size, align);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+struct arena_mark arena_mark(const struct arena *a) {
+    struct arena_mark mark = { a->cur, a->offset, a->stats.in_use };
+    return mark;
+}
+
+void arena_reset(struct arena *a, struct arena_mark mark) {
+    a->cur = mark.chunk;
+    a->offset = mark.offset;
+    a->stats.in_use = mark.in_use;
+}
+
+void arena_release(struct arena *a) {
+    struct arena_chunk *keep = NULL;
+    struct arena_chunk *next;
+
+    for (struct arena_chunk *chunk = a->head; chunk; chunk = next) {
+        next = chunk->next;
+        if (chunk->from_brk) {
+            // The break is not shrunk; the chunk is reused on the next alloc,
+            // but its pages past the header go back to the kernel now
+            keep = chunk;
+            keep->next = NULL;
+            uintptr_t start = ALIGN_UP((uintptr_t)chunk + CHUNK_HEADER, page_size());
+            uintptr_t end = (uintptr_t)chunk + chunk->size;
+            if (start < end) {
+                sys_madvise((void *)start, end - start, MADV_DONTNEED);
+            }
+        } else {
+            a->stats.reserved -= chunk->size;
+            sys_munmap(chunk, chunk->size);
+        }
+    }
+
+    a->head = keep;
+    a->cur = NULL;
+    a->offset = 0;
+    a->stats.in_use = 0;
+}
+
+void arena_print_stats(const char *name, const struct arena *a) {
+    mini_printf("Arena %s: high-water %lu bytes, %lu reserved, %lu mmap calls, %lu brk calls\n",
+                name, a->stats.high_water, a->stats.reserved,
+                a->stats.mmap_calls, a->stats.brk_calls);
+}
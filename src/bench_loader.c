@@ -0,0 +1,204 @@
+#include "arena.h"
+#include "elf_debug.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Launch benchmark: mini_loader against a plain kernel execve
+// Every image is launched `runs` times both ways (alternating, so drift
+// hits both equally) and each launch is timed from fork to the child's
+// exit. The corpus images exit right after entry, so that is close to
+// time-to-entry. Results go to stdout as CSV:
+//
+//   image,bytes,load_segments,method,runs,failures,launches_per_sec,p50_ns,p99_ns
+//
+// Under qemu-user, pass --wrap qemu-aarch64 so both kinds of child are
+// started through the emulator
+
+#define DEFAULT_RUNS 100
+#define MAX_LOADER_ARGS 8
+
+// Index into the per-image latency arrays
+#define METHOD_EXECVE 0
+#define METHOD_LOADER 1
+
+static struct arena scratch;
+static int devnull = -1;
+
+struct image_info {
+    size_t size;
+    int load_segments;
+};
+
+// File size and PT_LOAD count for the CSV columns
+static int image_info(const char *path, struct image_info *info) {
+    struct elf_image img;
+    if (elf_image_open(&img, path) < 0) {
+        return -1;
+    }
+
+    info->size = img.size;
+    info->load_segments = 0;
+    for (int i = 0; i < img.phnum; i++) {
+        if (img.phdrs[i].p_type == PT_LOAD) {
+            info->load_segments++;
+        }
+    }
+
+    elf_image_close(&img);
+    return 0;
+}
+
+// Fork, execve argv[0] with stdout/stderr sent to /dev/null, and wait
+// Returns the elapsed time in ns, or 0 if the launch failed
+static uint64_t launch(char **argv, char **envp) {
+    uint64_t start = monotonic_ns();
+    long pid = sys_fork();
+    if (pid < 0) {
+        return 0;
+    }
+
+    if (pid == 0) {
+        sys_dup3(devnull, 1, 0);
+        sys_dup3(devnull, 2, 0);
+        sys_execve(argv[0], argv, envp);
+        sys_exit(127);
+    }
+
+    int status = 0;
+    sys_wait4(pid, &status, 0, NULL);
+    uint64_t elapsed = monotonic_ns() - start;
+    return status == 0 ? elapsed : 0;
+}
+
+// Shell sort; run counts are small and this keeps the tool dependency-free
+static void sort_u64(uint64_t *v, size_t n) {
+    for (size_t gap = n / 2; gap > 0; gap /= 2) {
+        for (size_t i = gap; i < n; i++) {
+            uint64_t x = v[i];
+            size_t j = i;
+            while (j >= gap && v[j - gap] > x) {
+                v[j] = v[j - gap];
+                j -= gap;
+            }
+            v[j] = x;
+        }
+    }
+}
+
+static void print_row(const char *image, const struct image_info *info,
+                      const char *method, uint64_t *ns, size_t ok,
+                      size_t runs) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < ok; i++) {
+        total += ns[i];
+    }
+    sort_u64(ns, ok);
+
+    mini_printf("%s,%lu,%d,%s,%lu,%lu,", image, info->size,
+                info->load_segments, method, runs, runs - ok);
+    if (ok == 0 || total == 0) {
+        mini_printf("0,0,0\n");
+        return;
+    }
+    mini_printf("%lu,%lu,%lu\n", ok * 1000000000UL / total,
+                ns[(ok - 1) * 50 / 100], ns[(ok - 1) * 99 / 100]);
+}
+
+int main(int argc, char **argv, char **envp) {
+    unsigned long runs = DEFAULT_RUNS;
+    char *loader = "bin/mini_loader";
+    char *wrap = NULL;
+    char *loader_args[MAX_LOADER_ARGS];
+    int nloader_args = 0;
+    int argi = 1;
+
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (strcmp(argv[argi], "-n") == 0 && argi + 1 < argc) {
+            runs = parse_uint(argv[++argi]);
+        } else if (strcmp(argv[argi], "--loader") == 0 && argi + 1 < argc) {
+            loader = argv[++argi];
+        } else if (strcmp(argv[argi], "--loader-arg") == 0 && argi + 1 < argc &&
+                   nloader_args < MAX_LOADER_ARGS) {
+            loader_args[nloader_args++] = argv[++argi];
+        } else if (strcmp(argv[argi], "--wrap") == 0 && argi + 1 < argc) {
+            wrap = argv[++argi];
+        } else {
+            break;
+        }
+    }
+
+    if (argi >= argc || runs == 0) {
+        mini_eprintf("Usage: %s [-n runs] [--loader path] [--loader-arg arg]...\n"
+                     "       [--wrap emulator] <image>...\n", argv[0]);
+        return 1;
+    }
+
+    devnull = sys_openat(AT_FDCWD, "/dev/null", O_RDWR);
+    if (devnull < 0) {
+        mini_eprintf("Could not open /dev/null\n");
+        return 1;
+    }
+
+    uint64_t *ns[2];
+    ns[METHOD_EXECVE] = ARENA_ARRAY(&scratch, uint64_t, runs);
+    ns[METHOD_LOADER] = ARENA_ARRAY(&scratch, uint64_t, runs);
+    if (!ns[METHOD_EXECVE] || !ns[METHOD_LOADER]) {
+        mini_eprintf("Could not allocate %lu samples\n", runs);
+        return 1;
+    }
+
+    mini_printf("image,bytes,load_segments,method,runs,failures,"
+                "launches_per_sec,p50_ns,p99_ns\n");
+
+    int status = 0;
+    for (; argi < argc; argi++) {
+        char *image = argv[argi];
+        struct image_info info;
+        if (image_info(image, &info) < 0) {
+            mini_eprintf("Skipping %s: not a readable ELF file\n", image);
+            status = 1;
+            continue;
+        }
+
+        // [wrap] image   and   [wrap] loader [loader args] image
+        char *exec_argv[3];
+        char *loader_argv[MAX_LOADER_ARGS + 4];
+        int e = 0, l = 0;
+        if (wrap) {
+            exec_argv[e++] = wrap;
+            loader_argv[l++] = wrap;
+        }
+        exec_argv[e++] = image;
+        exec_argv[e] = NULL;
+        loader_argv[l++] = loader;
+        for (int i = 0; i < nloader_args; i++) {
+            loader_argv[l++] = loader_args[i];
+        }
+        loader_argv[l++] = image;
+        loader_argv[l] = NULL;
+
+        // One untimed launch each to warm the page cache
+        launch(exec_argv, envp);
+        launch(loader_argv, envp);
+
+        size_t ok[2] = { 0, 0 };
+        for (unsigned long r = 0; r < runs; r++) {
+            uint64_t t = launch(exec_argv, envp);
+            if (t) {
+                ns[METHOD_EXECVE][ok[METHOD_EXECVE]++] = t;
+            }
+            t = launch(loader_argv, envp);
+            if (t) {
+                ns[METHOD_LOADER][ok[METHOD_LOADER]++] = t;
+            }
+        }
+
+        print_row(image, &info, "execve", ns[METHOD_EXECVE], ok[METHOD_EXECVE], runs);
+        print_row(image, &info, "mini_loader", ns[METHOD_LOADER], ok[METHOD_LOADER], runs);
+        if (ok[METHOD_EXECVE] < runs || ok[METHOD_LOADER] < runs) {
+            status = 1;
+        }
+    }
+
+    return status;
+}
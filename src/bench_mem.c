@@ -0,0 +1,107 @@
+#include "syscalls.h"
+#include "utils.h"
+
+// Micro-benchmark for the memcpy/memset in utils.c
+// Compares them against the original byte-at-a-time loops for sizes
+// from 16 B to 64 MB and reports throughput in GB/s
+
+#define MIN_SIZE 16
+#define MAX_SIZE (64UL << 20)
+
+// Bytes moved per measurement; small sizes repeat until they reach this
+#define BYTES_PER_RUN (256UL << 20)
+
+// Original byte loops, kept here as the baseline
+__attribute__((noinline))
+static void *byte_memcpy(void *dest, const void *src, size_t n) {
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+    return dest;
+}
+
+__attribute__((noinline))
+static void *byte_memset(void *s, int c, size_t n) {
+    unsigned char *p = (unsigned char *)s;
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (unsigned char)c;
+    }
+    return s;
+}
+
+// Throughput in hundredths of GB/s (bytes per ns * 100)
+static unsigned long run_copy(void *(*fn)(void *, const void *, size_t),
+                              void *dst, const void *src, size_t size) {
+    size_t iters = BYTES_PER_RUN / size;
+    if (iters == 0) {
+        iters = 1;
+    }
+
+    uint64_t start = monotonic_ns();
+    for (size_t i = 0; i < iters; i++) {
+        fn(dst, src, size);
+        __asm__ __volatile__("" : : : "memory");
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+
+    return elapsed ? (unsigned long)(iters * size * 100 / elapsed) : 0;
+}
+
+static unsigned long run_set(void *(*fn)(void *, int, size_t),
+                             void *dst, size_t size) {
+    size_t iters = BYTES_PER_RUN / size;
+    if (iters == 0) {
+        iters = 1;
+    }
+
+    uint64_t start = monotonic_ns();
+    for (size_t i = 0; i < iters; i++) {
+        fn(dst, (int)i, size);
+        __asm__ __volatile__("" : : : "memory");
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+
+    return elapsed ? (unsigned long)(iters * size * 100 / elapsed) : 0;
+}
+
+static void print_rate(unsigned long rate) {
+    mini_printf("\t%lu.%02lu", rate / 100, rate % 100);
+}
+
+int main(void) {
+    void *src = sys_mmap(NULL, MAX_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *dst = sys_mmap(NULL, MAX_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (src == MAP_FAILED || dst == MAP_FAILED) {
+        mini_printf("Could not allocate benchmark buffers\n");
+        return 1;
+    }
+
+    // Touch every page up front so page faults stay out of the timings
+    memset(src, 0x5a, MAX_SIZE);
+    memset(dst, 0, MAX_SIZE);
+
+    mini_printf("Throughput in GB/s\n");
+    mini_printf("Size\tbyte_cpy\tmemcpy\tbyte_set\tmemset\n");
+
+    for (size_t size = MIN_SIZE; size <= MAX_SIZE; size <<= 1) {
+        if (size >= (1UL << 20)) {
+            mini_printf("%lu MB", size >> 20);
+        } else if (size >= (1UL << 10)) {
+            mini_printf("%lu KB", size >> 10);
+        } else {
+            mini_printf("%lu B", size);
+        }
+
+        print_rate(run_copy(byte_memcpy, dst, src, size));
+        print_rate(run_copy(memcpy, dst, src, size));
+        print_rate(run_set(byte_memset, dst, size));
+        print_rate(run_set(memset, dst, size));
+        mini_printf("\n");
+    }
+
+    return 0;
+}
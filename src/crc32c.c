@@ -0,0 +1,145 @@
+#include "crc32c.h"
+#include "elf_format.h"
+#include "utils.h"
+
+#define CRC32C_POLY 0x82f63b78U    // Castagnoli polynomial, bit-reflected
+
+// AT_HWCAP bit for the CRC32/CRC32C instructions
+#define HWCAP_CRC32 (1UL << 7)
+
+// Bytes each of the three streams covers per round. Large rounds keep the
+// cost of merging the partial CRCs (two multiplications) negligible;
+// what is left over goes through the small rounds, then single words.
+#define LARGE_BLOCK 8192
+#define SMALL_BLOCK 256
+
+static int initialized;
+static int have_hw;
+static uint32_t large_shift;       // x^(8 * LARGE_BLOCK) mod P
+static uint32_t small_shift;       // x^(8 * SMALL_BLOCK) mod P
+static uint32_t table[256];
+
+// The assembler may default to a base ARMv8.0 target without the
+// extension; the instructions are only reached when HWCAP_CRC32 is set
+static inline uint32_t crc32cx(uint32_t crc, uint64_t v) {
+    __asm__(".arch_extension crc\n\tcrc32cx %w0, %w0, %x1" : "+r"(crc) : "r"(v));
+    return crc;
+}
+
+static inline uint32_t crc32cb(uint32_t crc, uint8_t v) {
+    __asm__(".arch_extension crc\n\tcrc32cb %w0, %w0, %w1" : "+r"(crc) : "r"((uint32_t)v));
+    return crc;
+}
+
+// a * b mod P, both bit-reflected (bit 31 is x^0)
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1U << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^(8 * len) mod P: appending len zero bytes to a raw CRC multiplies it
+// by this
+static uint32_t shift_bytes(size_t len) {
+    uint32_t p = 1U << 31;         // x^0
+    uint32_t sq = 1U << 23;        // x^8
+    for (; len; len >>= 1) {
+        if (len & 1) {
+            p = multmodp(sq, p);
+        }
+        sq = multmodp(sq, sq);
+    }
+    return p;
+}
+
+static void crc32c_init(void) {
+    have_hw = (auxv_get(AT_HWCAP) & HWCAP_CRC32) != 0;
+    large_shift = shift_bytes(LARGE_BLOCK);
+    small_shift = shift_bytes(SMALL_BLOCK);
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        table[i] = c;
+    }
+    initialized = 1;
+}
+
+// Rounds of three interleaved streams of block bytes each. The raw CRC is
+// linear: crc(r, A B C) = (crc(r, A) * x^|B| ^ crc(0, B)) * x^|C| ^ crc(0, C)
+static uint32_t crc_streams(uint32_t crc, const uint8_t **buf, size_t *len,
+                            size_t block, uint32_t shift) {
+    const uint8_t *p = *buf;
+    size_t n = *len;
+    while (n >= 3 * block) {
+        const uint64_t *a = (const uint64_t *)p;
+        const uint64_t *b = (const uint64_t *)(p + block);
+        const uint64_t *c = (const uint64_t *)(p + 2 * block);
+        uint32_t crc_b = 0;
+        uint32_t crc_c = 0;
+        for (size_t i = 0; i < block / 8; i++) {
+            crc = crc32cx(crc, a[i]);
+            crc_b = crc32cx(crc_b, b[i]);
+            crc_c = crc32cx(crc_c, c[i]);
+        }
+        crc = multmodp(shift, multmodp(shift, crc) ^ crc_b) ^ crc_c;
+        p += 3 * block;
+        n -= 3 * block;
+    }
+    *buf = p;
+    *len = n;
+    return crc;
+}
+
+static uint32_t crc_hw(uint32_t crc, const uint8_t *p, size_t len) {
+    while (len > 0 && ((uintptr_t)p & 7)) {
+        crc = crc32cb(crc, *p++);
+        len--;
+    }
+    crc = crc_streams(crc, &p, &len, LARGE_BLOCK, large_shift);
+    crc = crc_streams(crc, &p, &len, SMALL_BLOCK, small_shift);
+    for (; len >= 8; p += 8, len -= 8) {
+        crc = crc32cx(crc, *(const uint64_t *)p);
+    }
+    while (len > 0) {
+        crc = crc32cb(crc, *p++);
+        len--;
+    }
+    return crc;
+}
+
+static uint32_t crc_table(uint32_t crc, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    return crc;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+    if (!initialized) {
+        crc32c_init();
+    }
+    const uint8_t *p = buf;
+    crc = ~crc;
+    crc = have_hw ? crc_hw(crc, p, len) : crc_table(crc, p, len);
+    return ~crc;
+}
+
+const char *crc32c_impl(void) {
+    if (!initialized) {
+        crc32c_init();
+    }
+    return have_hw ? "crc32cx" : "table";
+}
@@ -1,189 +1,238 @@
+#include "arena.h"
 #include "elf_debug.h"
 #include "syscalls.h"
+#include "tool_stream.h"
 #include "utils.h"
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        mini_printf("Usage: %s <elf_file>\n", argv[0]);
-        return 1;
+static struct record rec;
+
+// Scratch memory for each file's headers, reset after every file
+static struct arena scratch;
+
+// Header fields as one JSON object or TSV row; ident bytes and enums are
+// emitted as their raw numeric values
+static int emit_header(const char *path, const Elf64_Ehdr *hdr, int format) {
+    if (format == OUTPUT_JSON) {
+        record_printf(&rec, "{\"path\":");
+        record_json_string(&rec, path);
+        record_printf(&rec, ",\"class\":%d,\"data\":%d,\"osabi\":%d,"
+                      "\"type\":%d,\"machine\":%d,\"entry\":%lu,",
+                      hdr->e_ident[EI_CLASS], hdr->e_ident[EI_DATA],
+                      hdr->e_ident[EI_OSABI], hdr->e_type, hdr->e_machine,
+                      hdr->e_entry);
+        record_printf(&rec, "\"phoff\":%lu,\"shoff\":%lu,\"phentsize\":%d,"
+                      "\"phnum\":%d,\"shentsize\":%d,\"shnum\":%d}\n",
+                      hdr->e_phoff, hdr->e_shoff, hdr->e_phentsize,
+                      hdr->e_phnum, hdr->e_shentsize, hdr->e_shnum);
+    } else {
+        record_tsv_field(&rec, path);
+        record_printf(&rec, "\t%d\t%d\t%d\t%d\t%d\t0x%lx\t%lu\t%lu\t%d\t%d\t%d\t%d\n",
+                      hdr->e_ident[EI_CLASS], hdr->e_ident[EI_DATA],
+                      hdr->e_ident[EI_OSABI], hdr->e_type, hdr->e_machine,
+                      hdr->e_entry, hdr->e_phoff, hdr->e_shoff,
+                      hdr->e_phentsize, hdr->e_phnum, hdr->e_shentsize,
+                      hdr->e_shnum);
     }
+    return record_emit(&rec);
+}
 
-    const char *filename = argv[1];
+static void print_header(const Elf64_Ehdr *hdr) {
+    // Magic Bytes
+    mini_printf("Magic Bytes: %x %x %x %x\n", hdr->e_ident[EI_MAG0], hdr->e_ident[EI_MAG1], hdr->e_ident[EI_MAG2], hdr->e_ident[EI_MAG3]);
+   
+    // Class (ELF32/ELF64)
+    if (hdr->e_ident[EI_CLASS] == ELFCLASSNONE) {
+        mini_printf("Class: ELFNONE\n");
+    }
+    else if (hdr->e_ident[EI_CLASS] == ELFCLASS32) {
+        mini_printf("Class: ELF32\n");
+    }
+    else {
+        mini_printf("Class: ELF64\n");
+    }
+    
+    // Endianness
+    if (hdr->e_ident[EI_DATA] == ELFDATANONE) {
+        mini_printf("Data: Unkown data format\n");
+    }
+    else if (hdr->e_ident[EI_DATA] == ELFDATA2LSB) {
+        mini_printf("Data: 2's compliment, little endian\n");
+    }
+    else {
+        mini_printf("Data: 2's compliment, big endian\n");
+    }
 
-    // Your solution here!
-    int fd = sys_openat(AT_FDCWD, filename, O_RDONLY);
-    if (fd < 0) {
-        return -1;
+    // OS/ABI
+    if (hdr->e_ident[EI_OSABI] == ELFOSABI_NONE) {
+        mini_printf("OS/ABI: Unix - System V\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_SYSV) {
+        mini_printf("OS/ABI: Unix - System V\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_HPUX) {
+        mini_printf("OS/ABI: HP-UX\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_NETBSD) {
+        mini_printf("OS/ABI: NetBSD\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_LINUX) {
+        mini_printf("OS/ABI: Linux\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_SOLARIS) {
+        mini_printf("OS/ABI: Solaris\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_IRIX) {
+        mini_printf("OS/ABI: IRIX\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_FREEBSD) {
+        mini_printf("OS/ABI: FreeBSD\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_TRU64) {
+        mini_printf("OS/ABI: Unix - TRU64\n");
+    }
+    else if (hdr->e_ident[EI_OSABI] == ELFOSABI_ARM) {
+        mini_printf("OS/ABI: Arm\n");
+    }
+    else {
+        mini_printf("OS/ABI: Stand-alone (embedded)\n");
     }
 
-    Elf64_Ehdr hdr;
+    // Type
+    if (hdr->e_type == ET_NONE) {
+        mini_printf("Type: Unkown\n");
+    }
+    else if (hdr->e_type == ET_REL) {
+        mini_printf("Type: REL (Relocatable file)\n");
+    }
+    else if (hdr->e_type == ET_EXEC) {
+        mini_printf("Type: EXEC (Executable file)\n");
+    }
+    else if (hdr->e_type == ET_DYN) {
+        mini_printf("Type: DYN (Shared object)\n");
+    }
+    else {
+        mini_printf("Type: CORE (Core file)\n");
+    }
 
-    long bytes_read = sys_read(fd, &hdr, sizeof(hdr));
-    if (bytes_read < 0) {
-        return -1;
+    // Machine Architecture
+    switch (hdr->e_machine) {
+        case EM_NONE:
+            mini_printf("Machine: Unknown\n");
+            break;
+        case EM_M32:
+            mini_printf("Machine: AT&T WE 32100\n");
+            break;
+        case EM_SPARC:
+            mini_printf("Machine: Sun Microsystems SPARC\n");
+            break;
+        case EM_386:
+            mini_printf("Machine: Intel 80386\n");
+            break;
+        case EM_68K:
+            mini_printf("Machine: Motorola 68000\n");
+            break;
+        case EM_88K:
+            mini_printf("Machine: Motorola 88000\n");
+            break;
+        case EM_860:
+            mini_printf("Machine: Intel 80860\n");
+            break;
+        case EM_MIPS:
+            mini_printf("Machine: MIPS RS3000\n");
+            break;
+        case EM_PARISC:
+            mini_printf("Machine: HP/PA\n");
+            break;
+        case EM_SPARC32PLUS:
+            mini_printf("Machine: SPARC with enhanced instruction set\n");
+            break;
+        case EM_PPC:
+            mini_printf("Machine: PowerPC\n");
+            break;
+        case EM_PPC64:
+            mini_printf("Machine: PowerPC 64-bit\n");
+            break;
+        case EM_S390:
+            mini_printf("Machine: IBM S/390\n");
+            break;
+        case EM_ARM:
+            mini_printf("Machine: Advanced RISC Machines\n");
+            break;
+        case EM_SH:
+            mini_printf("Machine: Renesas SuperH\n");
+            break;
+        case EM_SPARCV9:
+            mini_printf("Machine: SPARC v9 64-bit\n");
+            break;
+        case EM_IA_64:
+            mini_printf("Machine: Intel Itanium\n");
+            break;
+        case EM_X86_64:
+            mini_printf("Machine: AMD x86-64\n");
+            break;
+        case EM_VAX:
+            mini_printf("Machine: DEC Vax\n");
+            break;
+        default:
+            mini_printf("Machine: Not matching any cases\n");
+            break;
     }
 
-    if (hdr.e_ident[EI_MAG0] == 0x7f &&
-        hdr.e_ident[EI_MAG1] == 'E' &&
-        hdr.e_ident[EI_MAG2] == 'L' &&
-        hdr.e_ident[EI_MAG3] == 'F') {
-        
-        // Magic Bytes
-        mini_printf("Magic Bytes: %x %x %x %x\n", hdr.e_ident[EI_MAG0], hdr.e_ident[EI_MAG1], hdr.e_ident[EI_MAG2], hdr.e_ident[EI_MAG3]);
-       
-        // Class (ELF32/ELF64)
-        if (hdr.e_ident[EI_CLASS] == ELFCLASSNONE) {
-            mini_printf("Class: ELFNONE\n");
-        }
-        else if (hdr.e_ident[EI_CLASS] == ELFCLASS32) {
-            mini_printf("Class: ELF32\n");
-        }
-        else {
-            mini_printf("Class: ELF64\n");
-        }
-        
-        // Endianness
-        if (hdr.e_ident[EI_DATA] == ELFDATANONE) {
-            mini_printf("Data: Unkown data format\n");
-        }
-        else if (hdr.e_ident[EI_DATA] == ELFDATA2LSB) {
-            mini_printf("Data: 2's compliment, little endian\n");
-        }
-        else {
-            mini_printf("Data: 2's compliment, big endian\n");
-        }
+    // Entry Point Address
+    mini_printf("Entry point address: 0x%lx\n", hdr->e_entry);
 
-        // OS/ABI
-        if (hdr.e_ident[EI_OSABI] == ELFOSABI_NONE) {
-            mini_printf("OS/ABI: Unix - System V\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_SYSV) {
-            mini_printf("OS/ABI: Unix - System V\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_HPUX) {
-            mini_printf("OS/ABI: HP-UX\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_NETBSD) {
-            mini_printf("OS/ABI: NetBSD\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_LINUX) {
-            mini_printf("OS/ABI: Linux\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_SOLARIS) {
-            mini_printf("OS/ABI: Solaris\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_IRIX) {
-            mini_printf("OS/ABI: IRIX\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_FREEBSD) {
-            mini_printf("OS/ABI: FreeBSD\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_TRU64) {
-            mini_printf("OS/ABI: Unix - TRU64\n");
-        }
-        else if (hdr.e_ident[EI_OSABI] == ELFOSABI_ARM) {
-            mini_printf("OS/ABI: Arm\n");
-        }
-        else {
-            mini_printf("OS/ABI: Stand-alone (embedded)\n");
-        }
+    // Program/Section Header Info
+    mini_printf("Start of program headers: %lu (bytes into file)\n", hdr->e_phoff);
+    mini_printf("Start of section headers: %lu (bytes into file)\n", hdr->e_shoff);
+    mini_printf("Size of program headers: %d (bytes)\n", hdr->e_phentsize);
+    mini_printf("Number of program headers: %d\n", hdr->e_phnum);
+    mini_printf("Size of section headers: %d (bytes)\n", hdr->e_shentsize);
+    mini_printf("Number of section headers: %d\n", hdr->e_shnum);
+}
 
-        // Type
-        if (hdr.e_type == ET_NONE) {
-            mini_printf("Type: Unkown\n");
-        }
-        else if (hdr.e_type == ET_REL) {
-            mini_printf("Type: REL (Relocatable file)\n");
-        }
-        else if (hdr.e_type == ET_EXEC) {
-            mini_printf("Type: EXEC (Executable file)\n");
-        }
-        else if (hdr.e_type == ET_DYN) {
-            mini_printf("Type: DYN (Shared object)\n");
-        }
-        else {
-            mini_printf("Type: CORE (Core file)\n");
-        }
+static int show_file(const char *path, void *arg) {
+    const struct tool_options *opts = arg;
 
-        // Machine Architecture
-        switch (hdr.e_machine) {
-            case EM_NONE:
-                mini_printf("Machine: Unknown\n");
-                break;
-            case EM_M32:
-                mini_printf("Machine: AT&T WE 32100\n");
-                break;
-            case EM_SPARC:
-                mini_printf("Machine: Sun Microsystems SPARC\n");
-                break;
-            case EM_386:
-                mini_printf("Machine: Intel 80386\n");
-                break;
-            case EM_68K:
-                mini_printf("Machine: Motorola 68000\n");
-                break;
-            case EM_88K:
-                mini_printf("Machine: Motorola 88000\n");
-                break;
-            case EM_860:
-                mini_printf("Machine: Intel 80860\n");
-                break;
-            case EM_MIPS:
-                mini_printf("Machine: MIPS RS3000\n");
-                break;
-            case EM_PARISC:
-                mini_printf("Machine: HP/PA\n");
-                break;
-            case EM_SPARC32PLUS:
-                mini_printf("Machine: SPARC with enhanced instruction set\n");
-                break;
-            case EM_PPC:
-                mini_printf("Machine: PowerPC\n");
-                break;
-            case EM_PPC64:
-                mini_printf("Machine: PowerPC 64-bit\n");
-                break;
-            case EM_S390:
-                mini_printf("Machine: IBM S/390\n");
-                break;
-            case EM_ARM:
-                mini_printf("Machine: Advanced RISC Machines\n");
-                break;
-            case EM_SH:
-                mini_printf("Machine: Renesas SuperH\n");
-                break;
-            case EM_SPARCV9:
-                mini_printf("Machine: SPARC v9 64-bit\n");
-                break;
-            case EM_IA_64:
-                mini_printf("Machine: Intel Itanium\n");
-                break;
-            case EM_X86_64:
-                mini_printf("Machine: AMD x86-64\n");
-                break;
-            case EM_VAX:
-                mini_printf("Machine: DEC Vax\n");
-                break;
-            default:
-                mini_printf("Machine: Not matching any cases\n");
-                break;
+    struct arena_mark mark = arena_mark(&scratch);
+    struct elf_image img;
+    if (elf_image_read_headers(&img, path, &scratch) < 0) {
+        arena_reset(&scratch, mark);
+        if (opts->format == OUTPUT_HUMAN && !opts->many) {
+            mini_printf("Not a valid ELF\n");
+        } else {
+            record_error(&rec, opts->format, path, "not a valid ELF file");
         }
+        return -1;
+    }
 
-        // Entry Point Address
-        mini_printf("Entry point address: 0x%x\n", hdr.e_entry);
+    int ret = 0;
+    if (opts->format == OUTPUT_HUMAN) {
+        if (opts->many) {
+            mini_printf("File: %s\n", path);
+        }
+        print_header(img.ehdr);
+        if (opts->many) {
+            mini_printf("\n");
+        }
+    } else if (emit_header(path, img.ehdr, opts->format) < 0) {
+        record_error(&rec, opts->format, path, "could not write record");
+        ret = -1;
+    }
+
+    arena_reset(&scratch, mark);
+    return ret;
+}
 
-        // Program/Section Header Info
-        mini_printf("Start of program headers: %d (bytes into file)\n", hdr.e_phoff);
-        mini_printf("Start of section headers: %d (bytes into file)\n", hdr.e_shoff);
-        mini_printf("Size of program headers: %d (bytes)\n", hdr.e_phentsize);
-        mini_printf("Number of program headers: %d\n", hdr.e_phnum);
-        mini_printf("Size of section headers: %d (bytes)\n", hdr.e_shnum);
- 
+int main(int argc, char **argv) {
+    struct tool_options opts;
+    if (tool_parse_args(argc, argv, &opts) < 0) {
+        return 1;
     }
-    else {
-        sys_write(1, "Not a valid ELF\n", sizeof("Not a valid ELF\n"));
-        return -1;
+
+    if (opts.format == OUTPUT_TSV) {
+        mini_printf("path\tclass\tdata\tosabi\ttype\tmachine\tentry\tphoff\t"
+                    "shoff\tphentsize\tphnum\tshentsize\tshnum\n");
     }
 
-    return 0;
+    return tool_for_each_path(argc, argv, &opts, show_file, &opts) ? 1 : 0;
 }
@@ -1,98 +1,145 @@
+#include "arena.h"
 #include "elf_debug.h"
 #include "syscalls.h"
+#include "tool_stream.h"
 #include "utils.h"
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        mini_printf("Usage: %s <elf_file>\n", argv[0]);
-        return 1;
+static struct record rec;
+
+// Scratch memory for each file's headers, reset after every file
+static struct arena scratch;
+
+// Printable name for a program header type
+static const char *phdr_type_name(uint32_t type) {
+    switch (type) {
+        case PT_NULL:         return "NULL";
+        case PT_LOAD:         return "LOAD";
+        case PT_DYNAMIC:      return "DYNAMIC";
+        case PT_INTERP:       return "INTERP";
+        case PT_NOTE:         return "NOTE";
+        case PT_SHLIB:        return "SHLIB";
+        case PT_PHDR:         return "PHDR";
+        case PT_TLS:          return "TLS";
+        case PT_GNU_EH_FRAME: return "GNU_EH_FRAME";
+        case PT_GNU_STACK:    return "GNU_STACK";
+        case PT_GNU_RELRO:    return "GNU_RELRO";
+        case PT_GNU_PROPERTY: return "GNU_PROPERTY";
+        default:
+            if (type >= PT_LOPROC && type <= PT_HIPROC) {
+                return "LOPROC+";
+            }
+            return "UNKNOWN";
     }
+}
 
-    const char *filename = argv[1];
+// All program headers of one file: a JSON object with a "phdrs" array, or
+// one TSV row per header
+static int emit_phdrs(const char *path, const struct elf_image *img, int format) {
+    if (format == OUTPUT_JSON) {
+        record_printf(&rec, "{\"path\":");
+        record_json_string(&rec, path);
+        record_printf(&rec, ",\"phdrs\":[");
+    }
 
-    // Your solution here!
-    int fd = sys_openat(AT_FDCWD, filename, O_RDONLY);
-    if (fd < 0) {
-        return -1;
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *phdr = &img->phdrs[i];
+        if (format == OUTPUT_JSON) {
+            record_printf(&rec, "%s{\"type\":\"%s\",\"offset\":%lu,\"vaddr\":%lu,"
+                          "\"paddr\":%lu,\"filesz\":%lu,\"memsz\":%lu,"
+                          "\"flags\":%u,\"align\":%lu}",
+                          i ? "," : "", phdr_type_name(phdr->p_type),
+                          phdr->p_offset, phdr->p_vaddr, phdr->p_paddr,
+                          phdr->p_filesz, phdr->p_memsz, phdr->p_flags,
+                          phdr->p_align);
+        } else {
+            record_tsv_field(&rec, path);
+            record_printf(&rec, "\t%d\t%s\t0x%lx\t0x%lx\t0x%lx\t0x%lx\t0x%lx\t%u\t0x%lx\n",
+                          i, phdr_type_name(phdr->p_type), phdr->p_offset,
+                          phdr->p_vaddr, phdr->p_paddr, phdr->p_filesz,
+                          phdr->p_memsz, phdr->p_flags, phdr->p_align);
+        }
     }
 
-    Elf64_Ehdr hdr;
-    long bytes_read = sys_read(fd, &hdr, sizeof(hdr));
-    if (bytes_read < 0) {
-        mini_printf("Unsuccessful read\n");
-        return -1;
+    if (format == OUTPUT_JSON) {
+        record_printf(&rec, "]}\n");
     }
+    return record_emit(&rec);
+}
 
-    int offset = sys_lseek(fd, hdr.e_phoff, SEEK_SET);
-    if (offset < 0) {
-        mini_printf("Unsuccessful lseek\n");
-        return -1;
+static void print_phdrs(const struct elf_image *img) {
+    if (img->phnum == 0) {
+        mini_printf("There are no program headers in this file.\n");
+        return;
     }
 
-    size_t size = hdr.e_phnum * sizeof(Elf64_Phdr);
+    const Elf64_Phdr *phdr_table = img->phdrs;
 
-    Elf64_Phdr phdr_table;
-    bytes_read = sys_read(fd, &phdr_table, size);
-    if (bytes_read < 0) {
-        mini_printf("Unsuccessful program header read\n");
-        return -1;
-    }
-    
     // Table Headers
     mini_printf("Program Headers:\n");
-    mini_printf("\tType\t\tOffset\t\tVirtAddr\t\tPhysAddr\n");
-    mini_printf("\t\t\t\tFileSiz\t\tMemSiz\t\t Flags  Align\n");
+    mini_printf("  %-14s %-18s %-18s %s\n", "Type", "Offset", "VirtAddr", "PhysAddr");
+    mini_printf("  %-14s %-18s %-18s  %-6s %s\n", "", "FileSiz", "MemSiz", "Flags", "Align");
+
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *phdr = &phdr_table[i];
+
+        // Type, File Offset, Virtual Address, Physical Address
+        mini_printf("  %-14s 0x%016lx 0x%016lx 0x%016lx\n",
+                    phdr_type_name(phdr->p_type), phdr->p_offset,
+                    phdr->p_vaddr, phdr->p_paddr);
+
+        // File Size, Memory Size, Flags (R/W/X), Alignment
+        mini_printf("  %-14s 0x%016lx 0x%016lx  %c%c%c    0x%lx\n", "",
+                    phdr->p_filesz, phdr->p_memsz,
+                    (phdr->p_flags & PF_R) ? 'R' : ' ',
+                    (phdr->p_flags & PF_W) ? 'W' : ' ',
+                    (phdr->p_flags & PF_X) ? 'E' : ' ',
+                    phdr->p_align);
+    }
+}
 
-    for (int i = 0; i < hdr.e_phnum; i ++) {
-        // Type
-        if (phdr_table[i].p_type == PT_NULL) {
-            mini_printf("NULL");
-        }
-        else if (phdr_table[i].p_type == PT_LOAD) {
-            mini_printf("LOAD");
-        }
-        else if (phdr_table[i].p_type == PT_DYNAMIC) {
-            mini_printf("DYNAMIC");
-        }
-        else if (phdr_table[i].p_type == PT_INTERP) {
-            mini_printf("INTERP");
-        }
-        else if (phdr_table[i].p_type == PT_NOTE) {
-            mini_printf("NOTE");
-        }
-        else if (phdr_table[i].p_type == PT_SHLIB) {
-            mini_printf("SHLIB");
+static int show_file(const char *path, void *arg) {
+    const struct tool_options *opts = arg;
+
+    struct arena_mark mark = arena_mark(&scratch);
+    struct elf_image img;
+    if (elf_image_read_headers(&img, path, &scratch) < 0) {
+        arena_reset(&scratch, mark);
+        if (opts->format == OUTPUT_HUMAN && !opts->many) {
+            mini_printf("Not a valid ELF file\n");
+        } else {
+            record_error(&rec, opts->format, path, "not a valid ELF file");
         }
-        else if (phdr_table[i].p_type == PT_PHDR) {
-            mini_printf("PHDR");
-        }
-        else if (phdr_table[i].p_type >= PT_LOPROC && phdr_table[i].p_type <= PT_HIPROC) {
-            mini_printf("LOPROC/HIPROC");
+        return -1;
+    }
+
+    int ret = 0;
+    if (opts->format == OUTPUT_HUMAN) {
+        if (opts->many) {
+            mini_printf("File: %s\n", path);
         }
-        else (phdr_table[i].p_type == PT_LOAD) {
-            mini_printf("GNU_STACK");
+        print_phdrs(&img);
+        if (opts->many) {
+            mini_printf("\n");
         }
+    } else if (emit_phdrs(path, &img, opts->format) < 0) {
+        record_error(&rec, opts->format, path, "could not write record");
+        ret = -1;
+    }
 
-        
-        // File Offset
-        
-        
-        // Virtual Address
-
-
-        // Physical Address
-
-
-        // File Size
-
-
-        // Memory Size
-
-
-        // Flags (R/W/X)
+    arena_reset(&scratch, mark);
+    return ret;
+}
 
+int main(int argc, char **argv) {
+    struct tool_options opts;
+    if (tool_parse_args(argc, argv, &opts) < 0) {
+        return 1;
+    }
 
-        // Alignment
+    if (opts.format == OUTPUT_TSV) {
+        mini_printf("path\tindex\ttype\toffset\tvaddr\tpaddr\tfilesz\tmemsz\t"
+                    "flags\talign\n");
+    }
 
-    return 0;
+    return tool_for_each_path(argc, argv, &opts, show_file, &opts) ? 1 : 0;
 }
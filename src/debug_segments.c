@@ -1,57 +1,159 @@
+#include "arena.h"
 #include "elf_debug.h"
 #include "syscalls.h"
+#include "tool_stream.h"
 #include "utils.h"
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        mini_printf("Usage: %s <elf_file>\n", argv[0]);
-        return 1;
+#define PAGE_SIZE page_size()
+#define PAGE_ALIGN_DOWN(x) ((x) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_UP(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+static struct record rec;
+
+// Scratch memory for each file's headers, reset after every file
+static struct arena scratch;
+
+// Every PT_LOAD segment of one file: a JSON object with a "segments"
+// array, or one TSV row per segment
+static int emit_segments(const char *path, const struct elf_image *img, int format) {
+    if (format == OUTPUT_JSON) {
+        record_printf(&rec, "{\"path\":");
+        record_json_string(&rec, path);
+        record_printf(&rec, ",\"page_size\":%lu,\"segments\":[", PAGE_SIZE);
     }
 
-    const char *filename = argv[1];
+    int segment = 0;
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *phdr = &img->phdrs[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
 
-    // Your solution here!
-    int fd = sys_openat(AT_FDCWD, filename, O_RDONLY);
-    if (fd < 0) {
-        mini_printf("Could not open file\n");
-        return -1;
+        uint64_t start = phdr->p_vaddr;
+        uint64_t end = phdr->p_vaddr + phdr->p_memsz;
+        uint64_t page_start = PAGE_ALIGN_DOWN(start);
+        uint64_t page_end = PAGE_ALIGN_UP(end);
+        uint64_t pages = (page_end - page_start) / PAGE_SIZE;
+
+        if (format == OUTPUT_JSON) {
+            record_printf(&rec, "%s{\"phdr\":%d,\"start\":%lu,\"end\":%lu,"
+                          "\"page_start\":%lu,\"page_end\":%lu,\"pages\":%lu,"
+                          "\"offset\":%lu,\"filesz\":%lu,\"memsz\":%lu,"
+                          "\"flags\":%u}",
+                          segment ? "," : "", i, start, end, page_start,
+                          page_end, pages, phdr->p_offset, phdr->p_filesz,
+                          phdr->p_memsz, phdr->p_flags);
+        } else {
+            record_tsv_field(&rec, path);
+            record_printf(&rec, "\t%d\t%d\t0x%lx\t0x%lx\t0x%lx\t0x%lx\t%lu\t0x%lx\t%lu\t%lu\t%u\n",
+                          segment, i, start, end, page_start, page_end, pages,
+                          phdr->p_offset, phdr->p_filesz, phdr->p_memsz,
+                          phdr->p_flags);
+        }
+        segment++;
     }
 
-    Elf64_Ehdr hdr;
-    long bytes_read = sys_read(fd, &hdr, sizeof(hdr));
-    if (bytes_read < 0) {
-        mini_printf("Unsuccessful elf header read\n");
-        return -1;
+    if (format == OUTPUT_JSON) {
+        record_printf(&rec, "]}\n");
     }
+    return record_emit(&rec);
+}
 
-    int offset = sys_lseek(fd, hdr.e_phoff, SEEK_SET);
-    if (offset < 0) {
-        mini_printf("Unsuccessful lseek\n");
-        return -1;
+static void print_segments_table(const struct elf_image *img) {
+    if (img->phnum == 0) {
+        mini_printf("There are no program headers in this file.\n");
+        return;
+    }
+
+    const Elf64_Phdr *phdr_table = img->phdrs;
+
+    int segment = 0;
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *phdr = &phdr_table[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+
+        uint64_t start = phdr->p_vaddr;
+        uint64_t end = phdr->p_vaddr + phdr->p_memsz;
+        uint64_t page_start = PAGE_ALIGN_DOWN(start);
+        uint64_t page_end = PAGE_ALIGN_UP(end);
+
+        mini_printf("Segment %d (program header %d):\n", segment++, i);
+
+        // Requested virtual address range
+        mini_printf("  Requested:    0x%016lx - 0x%016lx\n", start, end);
+
+        // Page-aligned address range
+        mini_printf("  Page-aligned: 0x%016lx - 0x%016lx\n", page_start, page_end);
+
+        // Size in bytes and pages
+        mini_printf("  Size:         %lu bytes (%lu pages)\n",
+                    phdr->p_memsz, (page_end - page_start) / PAGE_SIZE);
+
+        // File offset and size
+        mini_printf("  File:         offset 0x%lx, %lu bytes\n",
+                    phdr->p_offset, phdr->p_filesz);
+
+        // BSS/Zero-filled regions (if memsz > filesz)
+        if (phdr->p_memsz > phdr->p_filesz) {
+            mini_printf("  BSS:          0x%016lx - 0x%016lx (%lu bytes)\n",
+                        start + phdr->p_filesz, end,
+                        phdr->p_memsz - phdr->p_filesz);
+        } else {
+            mini_printf("  BSS:          none\n");
+        }
+
+        // Permissions
+        mini_printf("  Permissions: ");
+        if (phdr->p_flags & PF_R) mini_printf(" PROT_READ");
+        if (phdr->p_flags & PF_W) mini_printf(" PROT_WRITE");
+        if (phdr->p_flags & PF_X) mini_printf(" PROT_EXEC");
+        if (!(phdr->p_flags & (PF_R | PF_W | PF_X))) mini_printf(" PROT_NONE");
+        mini_printf("\n\n");
     }
+}
 
-    size_t size = hdr.e_phnum * sizeof(Elf64_Phdr);
+static int show_file(const char *path, void *arg) {
+    const struct tool_options *opts = arg;
 
-    Elf64_Phdr phdr_table;
-    bytes_read = sys_read(fd, &phdr_table, size);
-    if (bytes_read < 0) {
-        mini_printf("Unsuccessful program header read\n");
+    struct arena_mark mark = arena_mark(&scratch);
+    struct elf_image img;
+    if (elf_image_read_headers(&img, path, &scratch) < 0) {
+        arena_reset(&scratch, mark);
+        if (opts->format == OUTPUT_HUMAN && !opts->many) {
+            mini_printf("Not a valid ELF file\n");
+        } else {
+            record_error(&rec, opts->format, path, "not a valid ELF file");
+        }
         return -1;
     }
 
-    for (int i = 0; i < hdr.e_phnum; i ++) {
-        if (phdr_table[i].p_type == PT_LOAD) {
-            // Requested virtual address range
-            
-            // Page-aligned address range
-            
-            // Size in bytes and pages
+    int ret = 0;
+    if (opts->format == OUTPUT_HUMAN) {
+        if (opts->many) {
+            mini_printf("File: %s\n", path);
+        }
+        print_segments_table(&img);
+    } else if (emit_segments(path, &img, opts->format) < 0) {
+        record_error(&rec, opts->format, path, "could not write record");
+        ret = -1;
+    }
 
-            // File offset and size
+    arena_reset(&scratch, mark);
+    return ret;
+}
 
-            // BSS/Zero-filled regions (if memsz > filesz)
+int main(int argc, char **argv) {
+    struct tool_options opts;
+    if (tool_parse_args(argc, argv, &opts) < 0) {
+        return 1;
+    }
 
-            // Permissions
+    if (opts.format == OUTPUT_TSV) {
+        mini_printf("path\tsegment\tphdr\tstart\tend\tpage_start\tpage_end\t"
+                    "pages\toffset\tfilesz\tmemsz\tflags\n");
+    }
 
-    return 0;
+    return tool_for_each_path(argc, argv, &opts, show_file, &opts) ? 1 : 0;
 }
@@ -0,0 +1,479 @@
+#include "dynlink.h"
+#include "mini_loader.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Searched after --library-path and the requesting image's run path
+#define DEFAULT_LIBRARY_PATH "/lib/aarch64-linux-gnu:/usr/lib/aarch64-linux-gnu:/lib:/usr/lib"
+#define LIBRARY_PATH_MAX 4096
+
+// One image in the global scope, with the parts of its dynamic section
+// that linking needs (pointers are run-time addresses)
+struct dso {
+    struct loaded_image *image;
+    const char *name;            // DT_NEEDED string; "" for the main image
+    const char *runpath;         // DT_RUNPATH (or DT_RPATH), or NULL
+    const Elf64_Rela *rela;
+    size_t nrela;
+    const Elf64_Rela *jmprel;    // PLT relocations
+    size_t njmprel;
+    uintptr_t *pltgot;           // .got.plt: [1] = dso, [2] = resolver
+    uintptr_t init;              // DT_INIT, or 0
+    const uintptr_t *init_array;
+    size_t ninit;
+    int bind_now;                // DT_BIND_NOW, DF_BIND_NOW or DF_1_NOW
+};
+
+struct dynlink_stats dynlink_stats;
+
+static struct dso dsos[MAX_DSOS];
+static struct loaded_image lib_images[MAX_DSOS];
+static int ndsos;
+static int trace_binds;
+
+// PLT0 jumps here for an unbound JUMP_SLOT (dl_trampoline.S)
+void dynlink_plt_trampoline(void);
+// Called by the trampoline; returns the bound address
+uintptr_t dynlink_resolve(struct dso *dso, unsigned long index);
+
+// Writable run-time range for a relocation target, or NULL
+static void *writable_at(const struct loaded_image *li, uint64_t vaddr, uint64_t len) {
+    for (int i = 0; i < li->phnum; i++) {
+        const Elf64_Phdr *p = &li->phdrs[i];
+        if (p->p_type != PT_LOAD || !(p->p_flags & PF_W) || vaddr < p->p_vaddr) {
+            continue;
+        }
+        uint64_t off = vaddr - p->p_vaddr;
+        if (off <= p->p_memsz && len <= p->p_memsz - off) {
+            return (void *)(uintptr_t)(vaddr + li->load_bias);
+        }
+    }
+    return NULL;
+}
+
+static const char *dynstr_at(const struct loaded_image *li, uint64_t offset) {
+    if (!li->dynstr || offset >= li->dynstr_size) {
+        return NULL;
+    }
+    return li->dynstr + offset;
+}
+
+static int parse_dynamic(struct dso *d) {
+    const struct loaded_image *li = d->image;
+    uint64_t rela = 0, relasz = 0, jmprel = 0, pltrelsz = 0, pltrel = DT_RELA;
+    uint64_t pltgot = 0, init_array = 0, init_arraysz = 0, runpath = 0;
+    int have_runpath = 0;
+
+    for (size_t i = 0; i < li->file.dynnum; i++) {
+        const Elf64_Dyn *dyn = &li->file.dynamic[i];
+        switch (dyn->d_tag) {
+            case DT_RELA:         rela = dyn->d_un.d_ptr; break;
+            case DT_RELASZ:       relasz = dyn->d_un.d_val; break;
+            case DT_JMPREL:       jmprel = dyn->d_un.d_ptr; break;
+            case DT_PLTRELSZ:     pltrelsz = dyn->d_un.d_val; break;
+            case DT_PLTREL:       pltrel = dyn->d_un.d_val; break;
+            case DT_PLTGOT:       pltgot = dyn->d_un.d_ptr; break;
+            case DT_INIT:         d->init = dyn->d_un.d_ptr + li->load_bias; break;
+            case DT_INIT_ARRAY:   init_array = dyn->d_un.d_ptr; break;
+            case DT_INIT_ARRAYSZ: init_arraysz = dyn->d_un.d_val; break;
+            case DT_BIND_NOW:     d->bind_now = 1; break;
+            case DT_FLAGS:
+                if (dyn->d_un.d_val & DF_BIND_NOW) d->bind_now = 1;
+                break;
+            case DT_FLAGS_1:
+                if (dyn->d_un.d_val & DF_1_NOW) d->bind_now = 1;
+                break;
+            case DT_RPATH:
+                // DT_RUNPATH takes precedence when both are present
+                if (!have_runpath) runpath = dyn->d_un.d_val;
+                break;
+            case DT_RUNPATH:
+                runpath = dyn->d_un.d_val;
+                have_runpath = 1;
+                break;
+        }
+    }
+
+    if (rela && !(d->rela = loaded_image_at(li, rela, relasz))) {
+        return -1;
+    }
+    d->nrela = relasz / sizeof(Elf64_Rela);
+    if (jmprel) {
+        if (pltrel != DT_RELA || !(d->jmprel = loaded_image_at(li, jmprel, pltrelsz))) {
+            return -1;
+        }
+        d->njmprel = pltrelsz / sizeof(Elf64_Rela);
+    }
+    if (pltgot) {
+        d->pltgot = writable_at(li, pltgot, 3 * sizeof(uintptr_t));
+    }
+    if (init_array && init_arraysz) {
+        if (!(d->init_array = loaded_image_at(li, init_array, init_arraysz))) {
+            return -1;
+        }
+        d->ninit = init_arraysz / sizeof(uintptr_t);
+    }
+    if (runpath) {
+        d->runpath = dynstr_at(li, runpath);
+    }
+    return 0;
+}
+
+// Try dir/name for each entry of a colon-separated list
+static int open_in_path(const char *list, const char *name, char *path) {
+    size_t name_len = strlen(name);
+    while (list && *list) {
+        const char *end = list;
+        while (*end && *end != ':') {
+            end++;
+        }
+        size_t dir_len = end - list;
+        if (dir_len > 0 && dir_len + 1 + name_len < LIBRARY_PATH_MAX) {
+            memcpy(path, list, dir_len);
+            path[dir_len] = '/';
+            memcpy(path + dir_len + 1, name, name_len + 1);
+            int fd = sys_openat(AT_FDCWD, path, O_RDONLY);
+            if (fd >= 0) {
+                return fd;
+            }
+        }
+        list = *end ? end + 1 : end;
+    }
+    return -1;
+}
+
+// Open a DT_NEEDED library: names with a '/' are used as they are,
+// others are searched for in --library-path, the run path, then the
+// default directories
+static int open_library(const char *name, const struct dso *requester,
+                        const struct dynlink_config *cfg, char *path) {
+    for (const char *c = name; *c; c++) {
+        if (*c == '/') {
+            if (strlen(name) >= LIBRARY_PATH_MAX) {
+                return -1;
+            }
+            strcpy(path, name);
+            return sys_openat(AT_FDCWD, name, O_RDONLY);
+        }
+    }
+
+    int fd = open_in_path(cfg->library_path, name, path);
+    if (fd < 0) {
+        fd = open_in_path(requester->runpath, name, path);
+    }
+    if (fd < 0) {
+        fd = open_in_path(DEFAULT_LIBRARY_PATH, name, path);
+    }
+    return fd;
+}
+
+static int load_library(const char *name, const struct dso *requester,
+                        const struct dynlink_config *cfg) {
+    static char path[LIBRARY_PATH_MAX];
+
+    if (ndsos == MAX_DSOS) {
+        mini_printf("Too many libraries (limit %d)\n", MAX_DSOS - 1);
+        return -1;
+    }
+    int fd = open_library(name, requester, cfg, path);
+    if (fd < 0) {
+        mini_printf("Could not find library %s\n", name);
+        return -1;
+    }
+
+    mini_printf("Loading library: %s\n", path);
+    struct loaded_image *li = &lib_images[ndsos];
+    uintptr_t entry = map_elf_image_from_fd(fd, li);
+    sys_close(fd);
+    if (!entry) {
+        return -1;
+    }
+
+    for (int i = 0; i < li->phnum; i++) {
+        if (li->phdrs[i].p_type == PT_TLS) {
+            mini_printf("%s: thread-local storage is not supported\n", name);
+            return -1;
+        }
+    }
+
+    struct dso *d = &dsos[ndsos];
+    memset(d, 0, sizeof(*d));
+    d->image = li;
+    d->name = name;
+    if (parse_dynamic(d) < 0) {
+        mini_printf("%s: malformed dynamic section\n", name);
+        return -1;
+    }
+    ndsos++;
+    dynlink_stats.libraries++;
+    return 0;
+}
+
+// Load every DT_NEEDED entry of d that is not loaded yet
+static int load_needed(const struct dso *d, const struct dynlink_config *cfg) {
+    const struct loaded_image *li = d->image;
+    for (size_t i = 0; i < li->file.dynnum; i++) {
+        const Elf64_Dyn *dyn = &li->file.dynamic[i];
+        if (dyn->d_tag != DT_NEEDED) {
+            continue;
+        }
+        const char *name = dynstr_at(li, dyn->d_un.d_val);
+        if (!name) {
+            mini_printf("Malformed DT_NEEDED entry\n");
+            return -1;
+        }
+
+        int loaded = 0;
+        for (int j = 1; j < ndsos && !loaded; j++) {
+            loaded = strcmp(dsos[j].name, name) == 0;
+        }
+        if (!loaded && load_library(name, d, cfg) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Resolve symbol index of d against the global scope (main image first,
+// then libraries in load order), starting at scope entry first
+// Undefined weak symbols resolve to 0. Returns -1 if nothing defines it.
+static int resolve(const struct dso *d, uint32_t index, int first,
+                   uintptr_t *addr, const Elf64_Sym **def, const struct dso **def_dso) {
+    const struct loaded_image *li = d->image;
+    if (index >= li->dynsym_count) {
+        return -1;
+    }
+    const Elf64_Sym *sym = &li->dynsym[index];
+
+    if (ELF64_ST_BIND(sym->st_info) == STB_LOCAL && sym->st_shndx != SHN_UNDEF) {
+        *addr = loader_symbol_address(li, sym);
+        *def = sym;
+        *def_dso = d;
+        return 0;
+    }
+
+    const char *name = dynstr_at(li, sym->st_name);
+    if (!name) {
+        return -1;
+    }
+    for (int i = first; i < ndsos; i++) {
+        const Elf64_Sym *found = loader_find_dynsym(dsos[i].image, name);
+        if (found) {
+            *addr = loader_symbol_address(dsos[i].image, found);
+            *def = found;
+            *def_dso = &dsos[i];
+            return 0;
+        }
+    }
+
+    if (ELF64_ST_BIND(sym->st_info) == STB_WEAK) {
+        *addr = 0;
+        *def = NULL;
+        *def_dso = NULL;
+        return 0;
+    }
+    return -1;
+}
+
+static const char *symbol_name(const struct dso *d, uint32_t index) {
+    const struct loaded_image *li = d->image;
+    const char *name = NULL;
+    if (index < li->dynsym_count) {
+        name = dynstr_at(li, li->dynsym[index].st_name);
+    }
+    return name ? name : "?";
+}
+
+static int undefined(const struct dso *d, uint32_t index) {
+    mini_printf("Undefined symbol %s in %s\n", symbol_name(d, index),
+                d->name[0] ? d->name : "main image");
+    return -1;
+}
+
+// ABS64, GLOB_DAT, JUMP_SLOT and COPY entries of DT_RELA
+static int apply_symbolic(const struct dso *d) {
+    const struct loaded_image *li = d->image;
+
+    for (size_t i = 0; i < d->nrela; i++) {
+        const Elf64_Rela *r = &d->rela[i];
+        uint32_t type = ELF64_R_TYPE(r->r_info);
+        uint32_t index = ELF64_R_SYM(r->r_info);
+        uintptr_t addr = 0;
+        const Elf64_Sym *def;
+        const struct dso *def_dso;
+
+        if (type == R_AARCH64_ABS64 || type == R_AARCH64_GLOB_DAT ||
+            type == R_AARCH64_JUMP_SLOT) {
+            if (index && resolve(d, index, 0, &addr, &def, &def_dso) < 0) {
+                return undefined(d, index);
+            }
+            uintptr_t *where = writable_at(li, r->r_offset, sizeof(uintptr_t));
+            if (!where) {
+                return -1;
+            }
+            *where = addr + r->r_addend;
+        } else if (type == R_AARCH64_COPY) {
+            // The main image holds its own copy of a library's data object;
+            // the library's definition is the source, so skip the main image
+            if (resolve(d, index, 1, &addr, &def, &def_dso) < 0 || !def) {
+                return undefined(d, index);
+            }
+            const void *src = loaded_image_at(def_dso->image, def->st_value,
+                                              def->st_size);
+            void *dst = writable_at(li, r->r_offset, def->st_size);
+            if (!src || !dst) {
+                return -1;
+            }
+            memcpy(dst, src, def->st_size);
+        } else {
+            continue;
+        }
+        dynlink_stats.symbolic++;
+    }
+    return 0;
+}
+
+// Bind every PLT slot now, or point the slots at PLT0 and install the
+// resolver in .got.plt so each is bound on its first call
+static int setup_plt(struct dso *d, const struct dynlink_config *cfg) {
+    const struct loaded_image *li = d->image;
+    int lazy = !cfg->bind_now && !d->bind_now && d->pltgot;
+
+    for (size_t i = 0; i < d->njmprel; i++) {
+        const Elf64_Rela *r = &d->jmprel[i];
+        if (ELF64_R_TYPE(r->r_info) != R_AARCH64_JUMP_SLOT) {
+            loader_stats.reloc.unsupported++;
+            continue;
+        }
+        uintptr_t *slot = writable_at(li, r->r_offset, sizeof(uintptr_t));
+        if (!slot) {
+            return -1;
+        }
+
+        if (lazy) {
+            // The linker left the link-time address of PLT0 in the slot
+            *slot += li->load_bias;
+            dynlink_stats.lazy++;
+            continue;
+        }
+
+        uint32_t index = ELF64_R_SYM(r->r_info);
+        uintptr_t addr;
+        const Elf64_Sym *def;
+        const struct dso *def_dso;
+        if (resolve(d, index, 0, &addr, &def, &def_dso) < 0) {
+            return undefined(d, index);
+        }
+        *slot = addr + r->r_addend;
+        dynlink_stats.eager++;
+    }
+
+    if (lazy && d->njmprel) {
+        d->pltgot[1] = (uintptr_t)d;
+        d->pltgot[2] = (uintptr_t)dynlink_plt_trampoline;
+    }
+    return 0;
+}
+
+uintptr_t dynlink_resolve(struct dso *d, unsigned long index) {
+    if (index >= d->njmprel) {
+        mini_eprintf("mini_loader: bad PLT slot %lu\n", index);
+        sys_exit(127);
+    }
+
+    const Elf64_Rela *r = &d->jmprel[index];
+    uint32_t sym = ELF64_R_SYM(r->r_info);
+    uintptr_t addr;
+    const Elf64_Sym *def;
+    const struct dso *def_dso;
+    if (resolve(d, sym, 0, &addr, &def, &def_dso) < 0) {
+        mini_eprintf("mini_loader: undefined symbol %s\n", symbol_name(d, sym));
+        sys_exit(127);
+    }
+
+    // A single aligned store: threads racing on the same slot write the
+    // same value
+    addr += r->r_addend;
+    *(volatile uintptr_t *)(r->r_offset + d->image->load_bias) = addr;
+
+    dynlink_stats.lazy_bound++;
+    if (trace_binds) {
+        mini_eprintf("mini_loader: lazy bind %lu/%lu %s -> %p\n",
+                     dynlink_stats.lazy_bound, dynlink_stats.lazy,
+                     symbol_name(d, sym), (void *)addr);
+    }
+    return addr;
+}
+
+// Library constructors, dependencies before the libraries that need them
+// (reverse load order); the main image's startup code runs its own
+static void run_init(void) {
+    for (int i = ndsos - 1; i > 0; i--) {
+        const struct dso *d = &dsos[i];
+        if (d->init) {
+            ((void (*)(void))d->init)();
+        }
+        for (size_t j = 0; j < d->ninit; j++) {
+            uintptr_t fn = d->init_array[j];
+            if (fn != 0 && fn != (uintptr_t)-1) {
+                ((void (*)(void))fn)();
+            }
+        }
+    }
+}
+
+int dynlink_load(struct loaded_image *main_image, const struct dynlink_config *cfg) {
+    memset(&dynlink_stats, 0, sizeof(dynlink_stats));
+    trace_binds = cfg->trace;
+    ndsos = 0;
+
+    if (!main_image->dynsym) {
+        return 0;
+    }
+
+    memset(&dsos[0], 0, sizeof(dsos[0]));
+    dsos[0].image = main_image;
+    dsos[0].name = "";
+    if (parse_dynamic(&dsos[0]) < 0) {
+        mini_printf("Malformed dynamic section\n");
+        return -1;
+    }
+    ndsos = 1;
+
+    // Breadth first: the scope order is the order libraries are loaded in
+    for (int i = 0; i < ndsos; i++) {
+        if (load_needed(&dsos[i], cfg) < 0) {
+            return -1;
+        }
+    }
+
+    // Libraries first, so the main image's COPY relocations see data that
+    // is already relocated
+    for (int i = ndsos - 1; i >= 0; i--) {
+        if (apply_symbolic(&dsos[i]) < 0 || setup_plt(&dsos[i], cfg) < 0) {
+            mini_printf("Could not relocate %s\n",
+                        dsos[i].name[0] ? dsos[i].name : "main image");
+            return -1;
+        }
+    }
+
+    run_init();
+    return 0;
+}
+
+void dynlink_release(void) {
+    // dsos[0] is the main image, which belongs to the caller
+    for (int i = 1; i < ndsos; i++) {
+        loaded_image_close(dsos[i].image);
+    }
+}
+
+void dynlink_print_stats(void) {
+    const struct dynlink_stats *s = &dynlink_stats;
+    if (s->libraries == 0 && s->symbolic == 0 && s->eager == 0 && s->lazy == 0) {
+        return;
+    }
+    mini_printf("Libraries: %d\n", s->libraries);
+    mini_printf("Symbol bindings: %lu data, %lu PLT eager, %lu PLT lazy\n",
+                s->symbolic, s->eager, s->lazy);
+}
@@ -0,0 +1,463 @@
+#include "elf_debug.h"
+#include "syscalls.h"
+#include "tool_stream.h"
+#include "utils.h"
+
+// Header inventory for large file lists
+//
+//   elf_inventory [--depth N] [--json|--tsv] <file>...
+//   elf_inventory [--depth N] [--json|--tsv] -0 < list
+//
+// Every file takes an open, one or two reads of its first bytes and a
+// close. Instead of running those one file at a time, up to N files are in
+// flight on an io_uring: each slot is a small state machine that queues its
+// next operation when the previous one completes, and headers are parsed as
+// their reads land. Records therefore come out in completion order, not in
+// the order the paths were given.
+//
+// Where io_uring is unavailable (old kernel, seccomp, sysctl) the same state
+// machine runs on plain syscalls, one file at a time.
+
+#define DEFAULT_DEPTH 256
+#define MAX_DEPTH 1024
+#define PATH_MAX_LEN 4096
+
+// First read covers the ELF header and, for almost every file, the program
+// headers; files whose table lies further in get a second read, and those
+// whose table ends past SLOT_BUF are reported as too large
+#define HEAD_READ 4096
+#define SLOT_BUF (16UL << 10)
+
+// bytes_needed() result for a program header table that ends past SLOT_BUF
+#define HEADERS_TOO_LARGE ((size_t)-1)
+
+// Prepared SQEs are handed to the kernel once this many are waiting, even if
+// there are still free slots, so reads of stdin do not hold I/O back
+#define SUBMIT_BATCH 32
+
+#define SLOT_FREE 0
+#define SLOT_OPEN 1
+#define SLOT_READ 2
+#define SLOT_CLOSE 3
+
+struct slot {
+    int state;
+    int fd;
+    size_t len;                  // bytes of the file in buf
+    char path[PATH_MAX_LEN];
+    uint8_t buf[SLOT_BUF];
+};
+
+struct ring {
+    int fd;                      // -1: synchronous fallback
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    uint32_t sq_local_tail;      // SQEs prepared, published on submit
+    uint32_t pending;            // prepared but not yet submitted
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+struct inventory {
+    const struct tool_options *opts;
+    struct ring ring;
+    int depth;
+    int busy;                    // slots with an operation outstanding
+    int free_count;
+    int free_list[MAX_DEPTH];
+    unsigned long files;
+    unsigned long failed;
+    unsigned long enters;        // io_uring_enter calls that waited
+    unsigned long depth_sum;     // busy slots summed over those calls
+    int depth_max;
+};
+
+static struct record rec;
+static struct slot slots[MAX_DEPTH];
+static struct inventory inv;
+
+static const char *type_name(uint16_t type) {
+    switch (type) {
+        case ET_REL:  return "REL";
+        case ET_EXEC: return "EXEC";
+        case ET_DYN:  return "DYN";
+        case ET_CORE: return "CORE";
+        default:      return "UNKNOWN";
+    }
+}
+
+static const char *machine_name(uint16_t machine) {
+    switch (machine) {
+        case EM_X86_64:  return "x86-64";
+        case EM_AARCH64: return "AArch64";
+        default:         return "other";
+    }
+}
+
+// Map the SQ ring, CQ ring and SQE array of a fresh io_uring
+static int ring_init(struct ring *r, unsigned int entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    long fd = sys_io_uring_setup(entries, &p);
+    if (fd < 0) {
+        return (int)fd;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+    }
+
+    uint8_t *sq = sys_mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    uint8_t *cq = sq;
+    if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = sys_mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    void *sqes = MAP_FAILED;
+    if (sq != MAP_FAILED && cq != MAP_FAILED) {
+        sqes = sys_mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQES);
+    }
+    if (sqes == MAP_FAILED) {
+        // The mappings go away with the process; only the fd matters here
+        sys_close(fd);
+        return -1;
+    }
+
+    r->fd = (int)fd;
+    r->sq_head = (uint32_t *)(sq + p.sq_off.head);
+    r->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+    r->sq_mask = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (uint32_t *)(sq + p.sq_off.array);
+    r->sqes = sqes;
+    r->sq_local_tail = *r->sq_tail;
+    r->pending = 0;
+    r->cq_head = (uint32_t *)(cq + p.cq_off.head);
+    r->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+    r->cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+// Every busy slot has at most one operation prepared or in flight and the
+// SQ has depth entries, so there is always room
+static struct io_uring_sqe *ring_get_sqe(struct ring *r) {
+    uint32_t index = r->sq_local_tail & r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    r->sq_local_tail++;
+    r->pending++;
+    return sqe;
+}
+
+// Publish prepared SQEs and, if wait is set, block until one completes
+static int ring_submit(struct ring *r, int wait) {
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    if (wait) {
+        inv.enters++;
+        inv.depth_sum += inv.busy;
+        if (inv.busy > inv.depth_max) {
+            inv.depth_max = inv.busy;
+        }
+    }
+
+    for (;;) {
+        long n = sys_io_uring_enter(r->fd, r->pending, wait ? 1 : 0,
+                                    wait ? IORING_ENTER_GETEVENTS : 0);
+        if (n == -4) {           // EINTR
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        r->pending -= (uint32_t)n;
+        return 0;
+    }
+}
+
+static void advance(int index, long res);
+
+// Queue the next operation of a slot; without a ring it runs right away
+static void queue_op(int index, uint8_t opcode, uint64_t off, uint32_t len) {
+    struct slot *s = &slots[index];
+    struct ring *r = &inv.ring;
+
+    if (r->fd < 0) {
+        long res;
+        if (opcode == IORING_OP_OPENAT) {
+            res = sys_openat(AT_FDCWD, s->path, O_RDONLY);
+        } else if (opcode == IORING_OP_READ) {
+            sys_lseek(s->fd, (long)off, SEEK_SET);
+            res = sys_read(s->fd, s->buf + off, len);
+        } else {
+            res = sys_close(s->fd);
+        }
+        advance(index, res);
+        return;
+    }
+
+    struct io_uring_sqe *sqe = ring_get_sqe(r);
+    sqe->opcode = opcode;
+    sqe->user_data = (uint64_t)index;
+    if (opcode == IORING_OP_OPENAT) {
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)s->path;
+        sqe->op_flags = O_RDONLY;
+    } else {
+        sqe->fd = s->fd;
+        if (opcode == IORING_OP_READ) {
+            sqe->off = off;
+            sqe->addr = (uint64_t)(uintptr_t)(s->buf + off);
+            sqe->len = len;
+        }
+    }
+}
+
+// Bytes of the file the header needs in buf: the program header table end
+// once the ELF header is in, 0 if what is there already has to do (too
+// short or not ELF at all), or HEADERS_TOO_LARGE if the table does not fit
+// in buf
+static size_t bytes_needed(const struct slot *s) {
+    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)s->buf;
+    if (s->len < sizeof(Elf64_Ehdr) ||
+        ehdr->e_ident[EI_MAG0] != ELFMAG0 ||
+        ehdr->e_ident[EI_MAG1] != ELFMAG1 ||
+        ehdr->e_ident[EI_MAG2] != ELFMAG2 ||
+        ehdr->e_ident[EI_MAG3] != ELFMAG3) {
+        return 0;
+    }
+    uint64_t table = (uint64_t)ehdr->e_phnum * ehdr->e_phentsize;
+    if (ehdr->e_phoff > SLOT_BUF || table > SLOT_BUF - ehdr->e_phoff) {
+        return HEADERS_TOO_LARGE;
+    }
+    return ehdr->e_phoff + table;
+}
+
+// One file's headers: JSON object, TSV row or a line of the human listing
+static void emit_file(const char *path, const struct elf_image *img, int format) {
+    const Elf64_Ehdr *ehdr = img->ehdr;
+    int loads = 0;
+    int interp = 0;
+    uint64_t memsz = 0;
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *ph = &img->phdrs[i];
+        if (ph->p_type == PT_LOAD) {
+            loads++;
+            memsz += ph->p_memsz;
+        } else if (ph->p_type == PT_INTERP) {
+            interp = 1;
+        }
+    }
+    int pie = ehdr->e_type == ET_DYN;
+
+    if (format == OUTPUT_HUMAN) {
+        mini_printf("%s: %s %s, entry 0x%lx, %d phdrs, %d LOAD (0x%lx bytes)%s\n",
+                    path, machine_name(ehdr->e_machine), type_name(ehdr->e_type),
+                    ehdr->e_entry, img->phnum, loads, memsz,
+                    interp ? ", interp" : "");
+        return;
+    }
+
+    if (format == OUTPUT_JSON) {
+        record_printf(&rec, "{\"path\":");
+        record_json_string(&rec, path);
+        record_printf(&rec, ",\"type\":%d,\"machine\":%d,\"entry\":%lu,"
+                      "\"phnum\":%d,\"loads\":%d,\"memsz\":%lu,"
+                      "\"interp\":%s,\"pie\":%s}\n",
+                      ehdr->e_type, ehdr->e_machine, ehdr->e_entry, img->phnum,
+                      loads, memsz, interp ? "true" : "false",
+                      pie ? "true" : "false");
+    } else {
+        record_tsv_field(&rec, path);
+        record_printf(&rec, "\t%d\t%d\t0x%lx\t%d\t%d\t0x%lx\t%d\t%d\n",
+                      ehdr->e_type, ehdr->e_machine, ehdr->e_entry, img->phnum,
+                      loads, memsz, interp, pie);
+    }
+    if (record_emit(&rec) < 0) {
+        record_error(&rec, format, path, "could not write record");
+    }
+}
+
+static void fail(const char *path, const char *msg) {
+    inv.failed++;
+    record_error(&rec, inv.opts->format, path, msg);
+}
+
+static void release(int index) {
+    slots[index].state = SLOT_FREE;
+    inv.free_list[inv.free_count++] = index;
+    inv.busy--;
+}
+
+// Completion of a slot's current operation with syscall result res
+static void advance(int index, long res) {
+    struct slot *s = &slots[index];
+
+    switch (s->state) {
+        case SLOT_OPEN:
+            if (res < 0) {
+                fail(s->path, "cannot open file");
+                release(index);
+                return;
+            }
+            s->fd = (int)res;
+            s->len = 0;
+            s->state = SLOT_READ;
+            queue_op(index, IORING_OP_READ, 0, HEAD_READ);
+            return;
+
+        case SLOT_READ: {
+            if (res < 0) {
+                fail(s->path, "read failed");
+            } else {
+                s->len += (size_t)res;
+                size_t need = bytes_needed(s);
+                if (need != HEADERS_TOO_LARGE && res > 0 && need > s->len) {
+                    queue_op(index, IORING_OP_READ, s->len, (uint32_t)(need - s->len));
+                    return;
+                }
+
+                struct elf_image img;
+                if (need == HEADERS_TOO_LARGE) {
+                    fail(s->path, "program headers too large");
+                } else if (elf_image_from_headers(&img, s->buf, s->len) < 0) {
+                    fail(s->path, "not a valid ELF file");
+                } else {
+                    emit_file(s->path, &img, inv.opts->format);
+                }
+            }
+            s->state = SLOT_CLOSE;
+            queue_op(index, IORING_OP_CLOSE, 0, 0);
+            return;
+        }
+
+        case SLOT_CLOSE:
+            release(index);
+            return;
+    }
+}
+
+// Hand every completion that has arrived to its slot
+static void ring_reap(struct ring *r) {
+    uint32_t head = *r->cq_head;
+    uint32_t tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+        int index = (int)cqe->user_data;
+        long res = cqe->res;
+        head++;
+        // Free the CQE before advance() queues more work
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        advance(index, res);
+        tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    }
+}
+
+// Submit whatever is prepared and process at least one completion
+static int ring_wait(struct ring *r) {
+    if (ring_submit(r, 1) < 0) {
+        return -1;
+    }
+    ring_reap(r);
+    return 0;
+}
+
+static int queue_file(const char *path, void *arg) {
+    (void)arg;
+    struct ring *r = &inv.ring;
+
+    while (inv.free_count == 0) {
+        if (ring_wait(r) < 0) {
+            fail(path, "io_uring_enter failed");
+            return -1;
+        }
+    }
+
+    inv.files++;
+    if (strlen(path) >= PATH_MAX_LEN) {
+        fail(path, "path too long");
+        return -1;
+    }
+
+    int index = inv.free_list[--inv.free_count];
+    struct slot *s = &slots[index];
+    strcpy(s->path, path);
+    s->state = SLOT_OPEN;
+    inv.busy++;
+    queue_op(index, IORING_OP_OPENAT, 0, 0);
+
+    if (r->fd >= 0 && r->pending >= SUBMIT_BATCH && ring_submit(r, 0) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int depth = DEFAULT_DEPTH;
+    if (argc > 2 && strcmp(argv[1], "--depth") == 0) {
+        depth = (int)parse_uint(argv[2]);
+        if (depth < 1 || depth > MAX_DEPTH) {
+            mini_printf("%s: --depth takes 1 to %d\n", argv[0], MAX_DEPTH);
+            return 1;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    struct tool_options opts;
+    if (tool_parse_args(argc, argv, &opts) < 0) {
+        return 1;
+    }
+    inv.opts = &opts;
+
+    int err = ring_init(&inv.ring, depth);
+    if (err < 0) {
+        mini_eprintf("%s: io_uring unavailable (%d), reading files one at a time\n",
+                     argv[0], err);
+        inv.ring.fd = -1;
+        depth = 1;
+    }
+    inv.depth = depth;
+    for (int i = depth - 1; i >= 0; i--) {
+        inv.free_list[inv.free_count++] = i;
+    }
+
+    if (opts.format == OUTPUT_TSV) {
+        mini_printf("path\ttype\tmachine\tentry\tphnum\tloads\tmemsz\tinterp\tpie\n");
+    }
+
+    uint64_t start = monotonic_ns();
+    tool_for_each_path(argc, argv, &opts, queue_file, NULL);
+    while (inv.busy > 0) {
+        if (ring_wait(&inv.ring) < 0) {
+            mini_eprintf("%s: io_uring_enter failed with %d files open\n",
+                         argv[0], inv.busy);
+            return 1;
+        }
+    }
+    uint64_t ns = monotonic_ns() - start;
+
+    // Summary on stderr so it never mixes with the records
+    uint64_t rate = ns ? inv.files * 1000000000ULL / ns : 0;
+    mini_eprintf("%s: %lu files (%lu failed) in %lu.%03lu s, %lu files/s\n",
+                 argv[0], inv.files, inv.failed, ns / 1000000000ULL,
+                 ns / 1000000ULL % 1000, rate);
+    if (inv.ring.fd >= 0 && inv.enters > 0) {
+        uint64_t avg10 = inv.depth_sum * 10 / inv.enters;
+        mini_eprintf("%s: queue depth %d, in flight avg %lu.%lu max %d over %lu waits\n",
+                     argv[0], inv.depth, avg10 / 10, avg10 % 10, inv.depth_max,
+                     inv.enters);
+    }
+    return inv.failed ? 1 : 0;
+}
@@ -0,0 +1,489 @@
+#include "arena.h"
+#include "elf_format.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Synthetic AArch64 static-PIE generator for stress and benchmark corpora
+//
+// The image is one R+X segment holding the headers, an entry stub that calls
+// exit_group(0), .dynamic and the relocation table, followed by N-1 RW data
+// segments. Sizes, BSS ratio, layout quirks and the number of
+// R_AARCH64_RELATIVE relocations are all configurable. The output depends
+// only on the options, so a corpus can be regenerated instead of shipped.
+
+#ifndef DT_RELRSZ
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#define DT_RELRENT 37
+#endif
+
+// Alignment of every PT_LOAD: the largest AArch64 page size, so the images
+// load on 4K, 16K and 64K kernels alike
+#define SEG_ALIGN 0x10000UL
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+#define MAX_SEGMENTS 256
+#define WRITE_BUF_SIZE (1UL << 20)
+
+// Entry stub: mov x0, #0; mov x8, #94 (exit_group); svc #0
+static const uint32_t entry_code[] = { 0xd2800000, 0xd2800bc8, 0xd4000001 };
+
+struct options {
+    const char *out;
+    int segments;          // PT_LOAD count, text included
+    uint64_t text_size;    // filesz of the R+X segment (raised to fit headers)
+    uint64_t data_size;    // filesz of all data segments together
+    uint64_t bss_percent;  // extra memsz per data segment, in % of its filesz
+    uint64_t relocs;       // R_AARCH64_RELATIVE slots spread over data segments
+    int relr;              // encode them as DT_RELR instead of DT_RELA
+    uint64_t misalign;     // byte offset of every data segment inside its page
+    int straddle;          // pack segments so neighbours share file pages
+    int sparse;            // leave filler as file holes
+    uint64_t seed;         // filler PRNG seed
+};
+
+struct segment {
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t slots;        // relocation slots at the start of the segment
+    uint64_t slot_addr;    // vaddr of the first slot (8-byte aligned)
+};
+
+// Buffered sequential writer; gaps between write positions become holes
+struct writer {
+    int fd;
+    uint64_t pos;          // file offset of the next byte
+    size_t len;            // bytes buffered, ending at pos
+    uint8_t *buf;
+    int sparse;
+    uint64_t rng;
+    int failed;
+};
+
+static struct arena scratch;
+
+// Decimal with an optional K/M/G (binary) suffix
+static int parse_size(const char *s, uint64_t *out) {
+    uint64_t n = 0;
+    const char *p = s;
+    while (*p >= '0' && *p <= '9') {
+        n = n * 10 + (*p++ - '0');
+    }
+    if (p == s) {
+        return -1;
+    }
+    switch (*p) {
+        case 'K': case 'k': n <<= 10; p++; break;
+        case 'M': case 'm': n <<= 20; p++; break;
+        case 'G': case 'g': n <<= 30; p++; break;
+        default: break;
+    }
+    if (*p != '\0') {
+        return -1;
+    }
+    *out = n;
+    return 0;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static void writer_flush(struct writer *w) {
+    if (w->len == 0 || w->failed) {
+        w->len = 0;
+        return;
+    }
+    if (sys_lseek(w->fd, w->pos - w->len, SEEK_SET) < 0) {
+        w->failed = 1;
+        return;
+    }
+    size_t done = 0;
+    while (done < w->len) {
+        long n = sys_write(w->fd, w->buf + done, w->len - done);
+        if (n <= 0) {
+            w->failed = 1;
+            break;
+        }
+        done += n;
+    }
+    w->len = 0;
+}
+
+static void writer_emit(struct writer *w, const void *data, size_t n) {
+    const uint8_t *src = data;
+    while (n > 0) {
+        size_t chunk = WRITE_BUF_SIZE - w->len;
+        if (chunk > n) {
+            chunk = n;
+        }
+        memcpy(w->buf + w->len, src, chunk);
+        w->len += chunk;
+        w->pos += chunk;
+        src += chunk;
+        n -= chunk;
+        if (w->len == WRITE_BUF_SIZE) {
+            writer_flush(w);
+        }
+    }
+}
+
+// n bytes of pseudo-random filler, or a hole with --sparse
+static void writer_fill(struct writer *w, uint64_t n) {
+    if (w->sparse) {
+        writer_flush(w);
+        w->pos += n;
+        return;
+    }
+    while (n > 0) {
+        size_t chunk = WRITE_BUF_SIZE - w->len;
+        if (chunk > n) {
+            chunk = n;
+        }
+        for (size_t i = 0; i < chunk; i += 8) {
+            uint64_t v = xorshift64(&w->rng);
+            memcpy(w->buf + w->len + i, &v, chunk - i < 8 ? chunk - i : 8);
+        }
+        w->len += chunk;
+        w->pos += chunk;
+        n -= chunk;
+        if (w->len == WRITE_BUF_SIZE) {
+            writer_flush(w);
+        }
+    }
+}
+
+static void writer_seek(struct writer *w, uint64_t offset) {
+    writer_flush(w);
+    w->pos = offset;
+}
+
+// RELR encoding of sorted, 8-byte aligned addresses: an address word
+// starts a run, then bitmap words (low bit set) mark which of the next 63
+// words to relocate
+// Writes to out when it is non-NULL; returns the number of words
+static size_t encode_relr(const uint64_t *addrs, size_t n, uint64_t *out) {
+    size_t words = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        if (out) {
+            out[words] = addrs[i];
+        }
+        words++;
+        uint64_t base = addrs[i++] + 8;
+
+        for (;;) {
+            uint64_t bitmap = 0;
+            while (i < n && addrs[i] - base < 63 * 8) {
+                bitmap |= 1UL << ((addrs[i] - base) / 8);
+                i++;
+            }
+            if (!bitmap) {
+                break;
+            }
+            if (out) {
+                out[words] = (bitmap << 1) | 1;
+            }
+            words++;
+            base += 63 * 8;
+        }
+    }
+    return words;
+}
+
+static void usage(const char *prog) {
+    mini_eprintf("Usage: %s -o <out> [--segments N] [--text SIZE] [--data SIZE]\n"
+                 "       [--bss PERCENT] [--relocs N] [--relr] [--misalign BYTES]\n"
+                 "       [--straddle] [--sparse] [--seed N]\n"
+                 "SIZE takes a K/M/G suffix; data is split evenly over N-1 segments\n",
+                 prog);
+}
+
+static int parse_options(int argc, char **argv, struct options *o) {
+    o->out = NULL;
+    o->segments = 2;
+    o->text_size = 64 << 10;
+    o->data_size = 64 << 10;
+    o->bss_percent = 0;
+    o->relocs = 0;
+    o->relr = 0;
+    o->misalign = 0;
+    o->straddle = 0;
+    o->sparse = 0;
+    o->seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--relr") == 0) {
+            o->relr = 1;
+            continue;
+        } else if (strcmp(arg, "--straddle") == 0) {
+            o->straddle = 1;
+            continue;
+        } else if (strcmp(arg, "--sparse") == 0) {
+            o->sparse = 1;
+            continue;
+        }
+
+        // Everything else takes a value
+        if (i + 1 >= argc) {
+            mini_eprintf("Missing value for %s\n", arg);
+            return -1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(arg, "-o") == 0) {
+            o->out = val;
+            continue;
+        }
+
+        uint64_t n;
+        if (parse_size(val, &n) < 0) {
+            mini_eprintf("Bad value for %s: %s\n", arg, val);
+            return -1;
+        }
+        if (strcmp(arg, "--segments") == 0) {
+            o->segments = n > MAX_SEGMENTS ? MAX_SEGMENTS + 1 : (int)n;
+        } else if (strcmp(arg, "--text") == 0) {
+            o->text_size = n;
+        } else if (strcmp(arg, "--data") == 0) {
+            o->data_size = n;
+        } else if (strcmp(arg, "--bss") == 0) {
+            o->bss_percent = n;
+        } else if (strcmp(arg, "--relocs") == 0) {
+            o->relocs = n;
+        } else if (strcmp(arg, "--misalign") == 0) {
+            o->misalign = n;
+        } else if (strcmp(arg, "--seed") == 0) {
+            o->seed = n ? n : 1;
+        } else {
+            mini_eprintf("Unknown option %s\n", arg);
+            return -1;
+        }
+    }
+
+    if (!o->out) {
+        return -1;
+    }
+    if (o->segments < 2 || o->segments > MAX_SEGMENTS) {
+        mini_eprintf("--segments must be between 2 and %d\n", MAX_SEGMENTS);
+        return -1;
+    }
+    if (o->misalign >= SEG_ALIGN) {
+        mini_eprintf("--misalign must be below %lu\n", SEG_ALIGN);
+        return -1;
+    }
+    return 0;
+}
+
+// Place the segments; the text segment's size depends on the header and
+// relocation table sizes, so those are computed first
+static int layout(const struct options *o, struct segment *segs,
+                  uint64_t blob_size) {
+    int ndata = o->segments - 1;
+
+    segs[0].offset = 0;
+    segs[0].vaddr = 0;
+    segs[0].filesz = o->text_size > blob_size ? o->text_size : blob_size;
+    segs[0].memsz = segs[0].filesz;
+    segs[0].slots = 0;
+
+    for (int i = 1; i < o->segments; i++) {
+        struct segment *prev = &segs[i - 1];
+        struct segment *seg = &segs[i];
+        uint64_t prev_file_end = prev->offset + prev->filesz;
+
+        seg->offset = o->straddle ? prev_file_end + o->misalign
+                                  : ALIGN_UP(prev_file_end, SEG_ALIGN) + o->misalign;
+        // Same offset within a SEG_ALIGN page as in the file, never sharing
+        // a page with the previous segment in memory
+        seg->vaddr = ALIGN_UP(prev->vaddr + prev->memsz, SEG_ALIGN) +
+                     seg->offset % SEG_ALIGN;
+        seg->filesz = o->data_size / ndata;
+        if (i == o->segments - 1) {
+            seg->filesz += o->data_size % ndata;
+        }
+        seg->memsz = seg->filesz + seg->filesz / 100 * o->bss_percent +
+                     seg->filesz % 100 * o->bss_percent / 100;
+
+        seg->slots = o->relocs / ndata + ((uint64_t)(i - 1) < o->relocs % ndata);
+        seg->slot_addr = ALIGN_UP(seg->vaddr, 8);
+        if (seg->slots && seg->slot_addr + seg->slots * 8 > seg->vaddr + seg->filesz) {
+            mini_eprintf("Data segment %d is too small for %lu relocations\n",
+                         i, seg->slots);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct options o;
+    if (parse_options(argc, argv, &o) < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct segment segs[MAX_SEGMENTS];
+    // + PT_DYNAMIC, PT_GNU_STACK and a spare PT_NULL (left zeroed) that
+    // stamp_crc can turn into its checksum note
+    int phnum = o.segments + 3;
+    int ndyn = o.relocs ? 4 : 1;
+
+    // Text segment contents: ehdr, phdrs, entry stub, .dynamic, reloc table
+    // RELR space is reserved for the worst case of one word per slot
+    uint64_t phdrs_off = sizeof(Elf64_Ehdr);
+    uint64_t code_off = phdrs_off + phnum * sizeof(Elf64_Phdr);
+    uint64_t dyn_off = ALIGN_UP(code_off + sizeof(entry_code), 16);
+    uint64_t table_off = dyn_off + ndyn * sizeof(Elf64_Dyn);
+    uint64_t table_max = o.relocs * (o.relr ? 8 : sizeof(Elf64_Rela));
+    uint64_t blob_size = table_off + table_max;
+
+    if (layout(&o, segs, blob_size) < 0) {
+        return 1;
+    }
+
+    uint8_t *blob = arena_zalloc(&scratch, blob_size, 16);
+    uint8_t *buf = arena_alloc(&scratch, WRITE_BUF_SIZE, 16);
+    uint64_t *slots = ARENA_ARRAY(&scratch, uint64_t, o.relocs ? o.relocs : 1);
+    if (!blob || !buf || !slots) {
+        mini_eprintf("Could not allocate buffers\n");
+        return 1;
+    }
+
+    // Slot addresses in ascending order
+    size_t nslots = 0;
+    for (int s = 1; s < o.segments; s++) {
+        for (uint64_t i = 0; i < segs[s].slots; i++) {
+            slots[nslots++] = segs[s].slot_addr + i * 8;
+        }
+    }
+    uint64_t table_size = o.relr ? encode_relr(slots, nslots, NULL) * 8
+                                 : nslots * sizeof(Elf64_Rela);
+
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)blob;
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_ident[EI_OSABI] = ELFOSABI_NONE;
+    ehdr->e_type = ET_DYN;
+    ehdr->e_machine = EM_AARCH64;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_entry = code_off;
+    ehdr->e_phoff = phdrs_off;
+    ehdr->e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr->e_phentsize = sizeof(Elf64_Phdr);
+    ehdr->e_phnum = phnum;
+    ehdr->e_shentsize = sizeof(Elf64_Shdr);
+
+    Elf64_Phdr *phdrs = (Elf64_Phdr *)(blob + phdrs_off);
+    for (int i = 0; i < o.segments; i++) {
+        phdrs[i].p_type = PT_LOAD;
+        phdrs[i].p_flags = i == 0 ? (PF_R | PF_X) : (PF_R | PF_W);
+        phdrs[i].p_offset = segs[i].offset;
+        phdrs[i].p_vaddr = segs[i].vaddr;
+        phdrs[i].p_paddr = segs[i].vaddr;
+        phdrs[i].p_filesz = segs[i].filesz;
+        phdrs[i].p_memsz = segs[i].memsz;
+        phdrs[i].p_align = SEG_ALIGN;
+    }
+    Elf64_Phdr *dyn_phdr = &phdrs[o.segments];
+    dyn_phdr->p_type = PT_DYNAMIC;
+    dyn_phdr->p_flags = PF_R;
+    dyn_phdr->p_offset = dyn_off;
+    dyn_phdr->p_vaddr = dyn_off;
+    dyn_phdr->p_paddr = dyn_off;
+    dyn_phdr->p_filesz = ndyn * sizeof(Elf64_Dyn);
+    dyn_phdr->p_memsz = dyn_phdr->p_filesz;
+    dyn_phdr->p_align = 8;
+    Elf64_Phdr *stack_phdr = &phdrs[o.segments + 1];
+    stack_phdr->p_type = PT_GNU_STACK;
+    stack_phdr->p_flags = PF_R | PF_W;
+    stack_phdr->p_align = 16;
+
+    memcpy(blob + code_off, entry_code, sizeof(entry_code));
+
+    Elf64_Dyn *dyn = (Elf64_Dyn *)(blob + dyn_off);
+    if (o.relocs) {
+        dyn[0].d_tag = o.relr ? DT_RELR : DT_RELA;
+        dyn[0].d_un.d_ptr = table_off;
+        dyn[1].d_tag = o.relr ? DT_RELRSZ : DT_RELASZ;
+        dyn[1].d_un.d_val = table_size;
+        dyn[2].d_tag = o.relr ? DT_RELRENT : DT_RELAENT;
+        dyn[2].d_un.d_val = o.relr ? 8 : sizeof(Elf64_Rela);
+    }
+    dyn[ndyn - 1].d_tag = DT_NULL;
+
+    // Every slot is relocated to point at the entry stub
+    if (o.relr) {
+        encode_relr(slots, nslots, (uint64_t *)(blob + table_off));
+    } else {
+        Elf64_Rela *rela = (Elf64_Rela *)(blob + table_off);
+        for (size_t i = 0; i < nslots; i++) {
+            rela[i].r_offset = slots[i];
+            rela[i].r_info = ELF64_R_INFO(0, R_AARCH64_RELATIVE);
+            rela[i].r_addend = code_off;
+        }
+    }
+
+    int fd = sys_openat_mode(AT_FDCWD, o.out, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (fd < 0) {
+        mini_eprintf("Could not create %s\n", o.out);
+        return 1;
+    }
+
+    struct writer w = { fd, 0, 0, buf, o.sparse, o.seed, 0 };
+
+    // Text segment: the structures, then unused bytes up to --text
+    writer_emit(&w, blob, blob_size);
+    writer_fill(&w, segs[0].filesz - blob_size);
+
+    // Data segments: relocation slots (RELR keeps the link-time value in
+    // place, RELA takes it from the addend), then filler
+    for (int s = 1; s < o.segments; s++) {
+        writer_seek(&w, segs[s].offset);
+        uint64_t pad = segs[s].slots ? segs[s].slot_addr - segs[s].vaddr : 0;
+        uint64_t slot_value = o.relr ? code_off : 0;
+
+        writer_fill(&w, pad);
+        for (uint64_t i = 0; i < segs[s].slots; i++) {
+            writer_emit(&w, &slot_value, 8);
+        }
+        writer_fill(&w, segs[s].filesz - pad - segs[s].slots * 8);
+    }
+
+    writer_flush(&w);
+    uint64_t file_size = w.pos;
+    if (w.failed || sys_ftruncate(fd, file_size) < 0) {
+        mini_eprintf("Write to %s failed\n", o.out);
+        sys_close(fd);
+        return 1;
+    }
+    sys_close(fd);
+
+    mini_printf("Wrote %s: %lu bytes, %d PT_LOAD segments\n",
+                o.out, file_size, o.segments);
+    for (int i = 0; i < o.segments; i++) {
+        mini_printf("  [%d] %s offset 0x%lx vaddr 0x%lx filesz 0x%lx memsz 0x%lx",
+                    i, i == 0 ? "R-X" : "RW-", segs[i].offset, segs[i].vaddr,
+                    segs[i].filesz, segs[i].memsz);
+        if (segs[i].slots) {
+            mini_printf(" relocs %lu", segs[i].slots);
+        }
+        mini_printf("\n");
+    }
+    if (o.relocs) {
+        mini_printf("Relocations: %lu R_AARCH64_RELATIVE as %s (%lu bytes)\n",
+                    o.relocs, o.relr ? "DT_RELR" : "DT_RELA", table_size);
+    }
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "image_cache.h"
+#include "syscalls.h"
+#include "utils.h"
+
+#define PAGE_SIZE page_size()
+#define PAGE_ALIGN_DOWN(x) ((x) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_UP(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+#define CACHE_MAGIC 0x3145484341434c4dULL    // "MLCACHE1"
+#define CACHE_VERSION 2
+
+// First page of an entry; each segment's pages follow at a page-aligned
+// offset, laid out exactly as they appear in memory (BSS included)
+//
+// The build-id does not change when a file is edited in place (stamp_crc
+// does), so the entry also records which file it was staged from
+struct cache_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t size;               // whole entry, checked against fstat
+    uint32_t nsegs;
+    uint32_t reserved;
+    struct cache_source {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        int64_t mtime;
+        uint64_t mtime_nsec;
+    } source;
+    struct cache_seg {
+        uint32_t phdr;
+        uint32_t reserved;
+        uint64_t vaddr;          // vaddr/filesz/memsz must match the image
+        uint64_t filesz;
+        uint64_t memsz;
+        uint64_t offset;
+    } segs[IMAGE_CACHE_MAX_SEGS];
+};
+
+static uint64_t segment_span(const Elf64_Phdr *p) {
+    return PAGE_ALIGN_UP(p->p_vaddr + p->p_memsz) - PAGE_ALIGN_DOWN(p->p_vaddr);
+}
+
+// Read-only segments whose pages are not shared with any other segment;
+// mapping a shared page from the cache would clobber its neighbour
+static int cacheable(const struct elf_image *img, int index) {
+    const Elf64_Phdr *p = &img->phdrs[index];
+    if (p->p_type != PT_LOAD || (p->p_flags & PF_W) || p->p_memsz == 0) {
+        return 0;
+    }
+    uint64_t start = PAGE_ALIGN_DOWN(p->p_vaddr);
+    uint64_t end = PAGE_ALIGN_UP(p->p_vaddr + p->p_memsz);
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *q = &img->phdrs[i];
+        if (i == index || q->p_type != PT_LOAD || q->p_memsz == 0) {
+            continue;
+        }
+        if (PAGE_ALIGN_DOWN(q->p_vaddr) < end &&
+            PAGE_ALIGN_UP(q->p_vaddr + q->p_memsz) > start) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void source_of(struct cache_source *src, const struct stat *st) {
+    src->dev = st->st_dev;
+    src->ino = st->st_ino;
+    src->size = st->st_size;
+    src->mtime = st->st_mtime;
+    src->mtime_nsec = st->st_mtime_nsec;
+}
+
+// "b-<build-id hex>", or "i-<dev>-<ino>-<size>-<mtime>" without a build-id
+static void make_key(struct image_cache *c, const struct elf_image *img,
+                     const struct stat *st) {
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t *id;
+    size_t len;
+
+    if (elf_image_build_id(img, &id, &len) == 0 &&
+        2 + 2 * len < IMAGE_CACHE_KEY_MAX) {
+        char *k = c->key;
+        *k++ = 'b';
+        *k++ = '-';
+        for (size_t i = 0; i < len; i++) {
+            *k++ = hex[id[i] >> 4];
+            *k++ = hex[id[i] & 0xf];
+        }
+        *k = '\0';
+        return;
+    }
+
+    mini_snprintf(c->key, sizeof(c->key), "i-%lx-%lx-%lx-%lx.%lx",
+                  st->st_dev, st->st_ino, st->st_size, st->st_mtime, st->st_mtime_nsec);
+}
+
+// Check an existing entry against img and take its segment table
+// Returns 0 if it can be used, 1 if it is ours but was staged from another
+// file or an earlier version of this one, -1 otherwise
+static int read_entry(struct image_cache *c, int fd, const struct elf_image *img,
+                      const struct cache_source *src) {
+    struct stat st;
+    if (sys_fstat(fd, &st) < 0 || st.st_uid != (unsigned int)sys_getuid() ||
+        (st.st_mode & 022) || (unsigned long)st.st_size < PAGE_SIZE) {
+        return -1;
+    }
+
+    const struct cache_header *h = sys_mmap(NULL, PAGE_SIZE, PROT_READ,
+                                            MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) {
+        return -1;
+    }
+
+    int ok = h->magic == CACHE_MAGIC && h->version == CACHE_VERSION &&
+             h->page_size == PAGE_SIZE && h->size == (uint64_t)st.st_size &&
+             h->nsegs <= IMAGE_CACHE_MAX_SEGS;
+    for (uint32_t i = 0; ok && i < h->nsegs; i++) {
+        const struct cache_seg *s = &h->segs[i];
+        const Elf64_Phdr *p = s->phdr < (uint32_t)img->phnum ? &img->phdrs[s->phdr] : NULL;
+        ok = p && cacheable(img, s->phdr) && s->vaddr == p->p_vaddr &&
+             s->filesz == p->p_filesz && s->memsz == p->p_memsz &&
+             (s->offset & (PAGE_SIZE - 1)) == 0 && s->offset <= h->size &&
+             segment_span(p) <= h->size - s->offset;
+        c->segs[i].phdr = s->phdr;
+        c->segs[i].offset = s->offset;
+    }
+    c->nsegs = ok ? (int)h->nsegs : 0;
+    int stale = ok && memcmp(&h->source, src, sizeof(*src)) != 0;
+
+    sys_munmap((void *)h, PAGE_SIZE);
+    if (stale) {
+        c->nsegs = 0;
+        return 1;
+    }
+    return ok ? 0 : -1;
+}
+
+// Write a new entry under a temporary name and rename it into place
+static int stage_entry(struct image_cache *c, const struct elf_image *img,
+                       const struct cache_source *src, const char *name) {
+    static struct cache_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.page_size = PAGE_SIZE;
+    h.source = *src;
+
+    uint64_t size = PAGE_SIZE;
+    for (int i = 0; i < img->phnum && h.nsegs < IMAGE_CACHE_MAX_SEGS; i++) {
+        if (!cacheable(img, i)) {
+            continue;
+        }
+        const Elf64_Phdr *p = &img->phdrs[i];
+        struct cache_seg *s = &h.segs[h.nsegs++];
+        s->phdr = i;
+        s->vaddr = p->p_vaddr;
+        s->filesz = p->p_filesz;
+        s->memsz = p->p_memsz;
+        s->offset = size;
+        size += segment_span(p);
+    }
+    h.size = size;
+    if (h.nsegs == 0) {
+        return -1;
+    }
+
+    char tmp[sizeof(IMAGE_CACHE_DIR) + IMAGE_CACHE_KEY_MAX + 32];
+    mini_snprintf(tmp, sizeof(tmp), "%s.%ld", name, sys_getpid());
+    int fd = sys_openat_mode(AT_FDCWD, tmp, O_RDWR | O_CREAT | O_EXCL, 0444);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // ftruncate leaves the entry zero-filled, so only file bytes are copied
+    uint8_t *map = MAP_FAILED;
+    if (sys_ftruncate(fd, size) == 0) {
+        map = sys_mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        goto fail;
+    }
+    memcpy(map, &h, sizeof(h));
+    for (uint32_t i = 0; i < h.nsegs; i++) {
+        const struct cache_seg *s = &h.segs[i];
+        const Elf64_Phdr *p = &img->phdrs[s->phdr];
+        memcpy(map + s->offset + (p->p_vaddr - PAGE_ALIGN_DOWN(p->p_vaddr)),
+               img->data + p->p_offset, p->p_filesz);
+    }
+    sys_munmap(map, size);
+
+    if (sys_renameat(AT_FDCWD, tmp, AT_FDCWD, name) < 0) {
+        goto fail;
+    }
+
+    c->fd = fd;
+    c->staged = 1;
+    c->nsegs = h.nsegs;
+    for (uint32_t i = 0; i < h.nsegs; i++) {
+        c->segs[i].phdr = h.segs[i].phdr;
+        c->segs[i].offset = h.segs[i].offset;
+    }
+    return 0;
+
+fail:
+    sys_unlinkat(AT_FDCWD, tmp, 0);
+    sys_close(fd);
+    return -1;
+}
+
+int image_cache_open(struct image_cache *c, const struct elf_image *img,
+                     const char *path) {
+    c->fd = -1;
+    c->staged = 0;
+    c->nsegs = 0;
+    c->key[0] = '\0';
+    struct stat st;
+    if (sys_fstatat(AT_FDCWD, path, &st, 0) < 0) {
+        return -1;
+    }
+    struct cache_source src;
+    source_of(&src, &st);
+    make_key(c, img, &st);
+
+    char name[sizeof(IMAGE_CACHE_DIR) + IMAGE_CACHE_KEY_MAX + 16];
+    mini_snprintf(name, sizeof(name), "%s/mini_loader-%s", IMAGE_CACHE_DIR, c->key);
+
+    int fd = sys_openat(AT_FDCWD, name, O_RDONLY);
+    if (fd >= 0) {
+        int ret = read_entry(c, fd, img, &src);
+        if (ret == 0) {
+            c->fd = fd;
+            return 0;
+        }
+        // A stale entry is dropped even if staging its replacement fails;
+        // a foreign one is only replaced by the rename below
+        sys_close(fd);
+        if (ret > 0) {
+            sys_unlinkat(AT_FDCWD, name, 0);
+        }
+    }
+    return stage_entry(c, img, &src, name);
+}
+
+long image_cache_segment(const struct image_cache *c, int index) {
+    if (c->fd < 0) {
+        return -1;
+    }
+    for (int i = 0; i < c->nsegs; i++) {
+        if (c->segs[i].phdr == index) {
+            return c->segs[i].offset;
+        }
+    }
+    return -1;
+}
+
+void image_cache_close(struct image_cache *c) {
+    if (c->fd >= 0) {
+        sys_close(c->fd);
+    }
+    c->fd = -1;
+    c->nsegs = 0;
+}
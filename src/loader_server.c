@@ -0,0 +1,171 @@
+#include "mini_loader.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Fork-server ("warm pool") mode for mini_loader
+//
+// The image is read, mapped and protected once. Each request is a line on
+// stdin holding the arguments for one run; the server forks, and the child
+// jumps straight into the already-mapped image with its own argv. Children
+// share every page with the server until they write to it (copy-on-write),
+// so a launch costs a fork instead of open/read/mmap/mprotect.
+//
+// Example:
+//   printf 'a b\nc\n' | ./bin/mini_loader --server bin/sample
+
+#define REQUEST_BUF_SIZE 4096
+#define MAX_REQUEST_ARGS 64
+
+// Latency summary across all requests
+struct server_stats {
+    unsigned long requests;
+    unsigned long failures;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    long minor_faults;    // summed over children, from wait4's rusage
+    long major_faults;
+};
+
+// Split line in place on spaces/tabs; argv[0] is the image path
+static int split_args(char *line, const char *path, char **argv) {
+    int argc = 0;
+    argv[argc++] = (char *)path;
+
+    char *p = line;
+    while (*p && argc < MAX_REQUEST_ARGS) {
+        while (*p == ' ' || *p == '\t') {
+            *p++ = '\0';
+        }
+        if (!*p) {
+            break;
+        }
+        argv[argc++] = p;
+        while (*p && *p != ' ' && *p != '\t') {
+            p++;
+        }
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+// Fork one pre-mapped child for a request and wait for it
+// Returns the child's wait status, or -1 if fork failed
+static int serve_request(uintptr_t entry, char *line, const char *path,
+                         char **envp, struct server_stats *stats) {
+    char *argv[MAX_REQUEST_ARGS + 1];
+    int argc = split_args(line, path, argv);
+
+    // Anything still buffered would be written twice after fork
+    output_flush();
+
+    uint64_t start = monotonic_ns();
+    long pid = sys_fork();
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Requests arrive on stdin, so the child must not read from it
+        int devnull = sys_openat(AT_FDCWD, "/dev/null", O_RDONLY);
+        if (devnull >= 0) {
+            sys_dup3(devnull, 0, 0);
+            sys_close(devnull);
+        }
+        start_program(entry, argc, argv, envp);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    sys_wait4(pid, &status, 0, &usage);
+    uint64_t elapsed = monotonic_ns() - start;
+
+    stats->requests++;
+    stats->total_ns += elapsed;
+    if (stats->requests == 1 || elapsed < stats->min_ns) {
+        stats->min_ns = elapsed;
+    }
+    if (elapsed > stats->max_ns) {
+        stats->max_ns = elapsed;
+    }
+    stats->minor_faults += usage.ru_minflt;
+    stats->major_faults += usage.ru_majflt;
+    if (status != 0) {
+        stats->failures++;
+    }
+    return status;
+}
+
+static void print_server_stats(const struct server_stats *stats, uint64_t wall_ns) {
+    mini_printf("Server: %lu requests, %lu failed\n",
+                stats->requests, stats->failures);
+    if (stats->requests == 0 || wall_ns == 0) {
+        return;
+    }
+    mini_printf("Server: %lu requests/sec\n",
+                stats->requests * 1000000000UL / wall_ns);
+    mini_printf("Server: launch latency min %lu us, avg %lu us, max %lu us\n",
+                stats->min_ns / 1000,
+                stats->total_ns / stats->requests / 1000,
+                stats->max_ns / 1000);
+    mini_printf("Server: avg faults per launch %ld minor, %ld major\n",
+                stats->minor_faults / (long)stats->requests,
+                stats->major_faults / (long)stats->requests);
+}
+
+int run_server(const char *path, char **envp) {
+    uintptr_t entry = load_image(path);
+    if (!entry) {
+        return 1;
+    }
+
+    mini_printf("Server: image mapped, reading requests from stdin\n");
+
+    struct server_stats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    char buf[REQUEST_BUF_SIZE];
+    size_t len = 0;
+    uint64_t wall_start = monotonic_ns();
+
+    for (;;) {
+        long n = sys_read(0, buf + len, sizeof(buf) - 1 - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+
+        // Serve every complete line in the buffer
+        size_t line_start = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (buf[i] != '\n') {
+                continue;
+            }
+            buf[i] = '\0';
+            if (serve_request(entry, buf + line_start, path, envp, &stats) < 0) {
+                mini_printf("Server: fork failed\n");
+                print_server_stats(&stats, monotonic_ns() - wall_start);
+                return 1;
+            }
+            line_start = i + 1;
+        }
+
+        memmove(buf, buf + line_start, len - line_start);
+        len -= line_start;
+
+        if (len == sizeof(buf) - 1) {
+            mini_printf("Server: request line too long, dropped\n");
+            len = 0;
+        }
+    }
+
+    // A final request without a trailing newline
+    if (len > 0) {
+        buf[len] = '\0';
+        serve_request(entry, buf, path, envp, &stats);
+    }
+
+    print_server_stats(&stats, monotonic_ns() - wall_start);
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include "lz4.h"
+#include "utils.h"
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+// The format requires the last 5 bytes to be literals and the last match
+// to start at least 12 bytes before the end of the block
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Write a length of 15 or more as its continuation bytes
+static uint8_t *put_length(uint8_t *op, size_t len) {
+    for (len -= 15; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// One sequence: nlit literals, then (if match_len) a match at offset back
+// Returns the new output position, or NULL if it would pass oend
+static uint8_t *put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit,
+                             size_t nlit, size_t offset, size_t match_len) {
+    size_t ml = match_len ? match_len - MIN_MATCH : 0;
+    size_t need = 1 + nlit + nlit / 255 + 1 + (match_len ? 2 + ml / 255 + 1 : 0);
+    if (need > (size_t)(oend - op)) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = (uint8_t)((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15) {
+        op = put_length(op, nlit);
+    }
+    memcpy(op, lit, nlit);
+    op += nlit;
+
+    if (match_len) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)(ml < 15 ? ml : 15);
+        if (ml >= 15) {
+            op = put_length(op, ml);
+        }
+    }
+    return op;
+}
+
+// Greedy single-probe matcher: good ratios on code and rodata at a few
+// hundred MB/s, which is plenty for a packer
+size_t lz4_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                    uint32_t *table) {
+    uint8_t *op = dst;
+    uint8_t *oend = dst + cap;
+    const uint8_t *anchor = src;
+
+    // Positions are stored + 1 so that 0 means empty
+    memset(table, 0, LZ4_HASH_SIZE * sizeof(uint32_t));
+
+    if (len > MF_LIMIT) {
+        const uint8_t *ip = src;
+        const uint8_t *mflimit = src + len - MF_LIMIT;
+        const uint8_t *matchlimit = src + len - LAST_LITERALS;
+
+        while (ip < mflimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash32(seq);
+            size_t pos = ip - src;
+            size_t ref = table[h];
+            table[h] = (uint32_t)(pos + 1);
+            if (ref == 0 || pos + 1 - ref > MAX_OFFSET || read32(src + ref - 1) != seq) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t *match = src + ref - 1;
+            while (ip > anchor && match > src && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+            const uint8_t *end = ip + MIN_MATCH;
+            const uint8_t *m = match + MIN_MATCH;
+            while (end < matchlimit && *end == *m) {
+                end++;
+                m++;
+            }
+
+            op = put_sequence(op, oend, anchor, ip - anchor, ip - match, end - ip);
+            if (!op) {
+                return 0;
+            }
+            ip = anchor = end;
+        }
+    }
+
+    op = put_sequence(op, oend, anchor, src + len - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+// Read the continuation bytes of a length that started at 15
+static int get_length(const uint8_t **ipp, const uint8_t *iend, size_t *len) {
+    const uint8_t *ip = *ipp;
+    uint8_t b;
+    do {
+        if (ip >= iend) {
+            return -1;
+        }
+        b = *ip++;
+        *len += b;
+    } while (b == 255);
+    *ipp = ip;
+    return 0;
+}
+
+long lz4_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + src_len;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_len;
+
+    for (;;) {
+        if (ip >= iend) {
+            return -1;
+        }
+        unsigned token = *ip++;
+
+        // Short sequences far from either end: fixed-size copies that may
+        // run past the sequence into bytes the next one overwrites
+        if ((token >> 4) < 15 && (token & 15) < 15 &&
+            iend - ip >= 32 && oend - op >= 32) {
+            size_t nlit = token >> 4;
+            memcpy(op, ip, 16);
+            op += nlit;
+            ip += nlit;
+
+            size_t offset = ip[0] | (size_t)ip[1] << 8;
+            size_t match_len = (token & 15) + MIN_MATCH;
+            if (offset >= 16 && offset <= (size_t)(op - dst)) {
+                ip += 2;
+                memcpy(op, op - offset, 16);
+                memcpy(op + 16, op + 16 - offset, 2);
+                op += match_len;
+                continue;
+            }
+            // Rare overlapping or bad match: take the general path for it
+            ip -= nlit;
+            op -= nlit;
+        }
+
+        size_t nlit = token >> 4;
+        if (nlit == 15 && get_length(&ip, iend, &nlit) < 0) {
+            return -1;
+        }
+        if (nlit > (size_t)(iend - ip) || nlit > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, nlit);
+        op += nlit;
+        ip += nlit;
+
+        // Only the last sequence ends after its literals
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && get_length(&ip, iend, &match_len) < 0) {
+            return -1;
+        }
+        match_len += MIN_MATCH;
+        if (match_len > (size_t)(oend - op)) {
+            return -1;
+        }
+
+        // Overlapping matches repeat the last offset bytes, so they are
+        // copied in steps of at most offset bytes
+        const uint8_t *match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+        } else if (offset >= 8) {
+            for (size_t i = 0; i < match_len; i += offset) {
+                size_t n = match_len - i < offset ? match_len - i : offset;
+                memcpy(op + i, match + i, n);
+            }
+        } else {
+            for (size_t i = 0; i < match_len; i++) {
+                op[i] = match[i];
+            }
+        }
+        op += match_len;
+    }
+
+    return op - dst;
+}
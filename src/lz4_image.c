@@ -0,0 +1,66 @@
+#include "lz4_image.h"
+#include "utils.h"
+
+int lz4_image_detect(const void *data, size_t size) {
+    return size >= sizeof(struct lz4_image_header) &&
+           memcmp(data, LZ4_IMAGE_MAGIC, 8) == 0;
+}
+
+// Whether [offset, offset + len) lies inside the container
+static int in_container(const struct lz4_image *c, uint64_t offset, uint64_t len) {
+    return offset <= c->size && c->size - offset >= len;
+}
+
+int lz4_image_open(struct lz4_image *c, const void *data, size_t size) {
+    memset(c, 0, sizeof(*c));
+    c->data = data;
+    c->size = size;
+    if (!lz4_image_detect(data, size)) {
+        return -1;
+    }
+
+    const struct lz4_image_header *h = data;
+    // The ELF headers are read in place, so they must be 8-byte aligned
+    if (h->version != LZ4_IMAGE_VERSION || h->headers_offset % 8 != 0 ||
+        h->nsegs > (size - sizeof(*h)) / sizeof(struct lz4_image_segment) ||
+        !in_container(c, h->headers_offset, h->headers_size) ||
+        elf_image_from_headers(&c->elf, c->data + h->headers_offset,
+                               h->headers_size) < 0) {
+        return -1;
+    }
+    c->segs = (const struct lz4_image_segment *)(c->data + sizeof(*h));
+    c->nsegs = h->nsegs;
+    c->elf_size = h->elf_size;
+
+    for (uint32_t i = 0; i < c->nsegs; i++) {
+        const struct lz4_image_segment *s = &c->segs[i];
+        if (s->phdr >= (uint32_t)c->elf.phnum ||
+            c->elf.phdrs[s->phdr].p_type != PT_LOAD ||
+            c->elf.phdrs[s->phdr].p_filesz != s->raw_size ||
+            !in_container(c, s->offset, s->size)) {
+            return -1;
+        }
+    }
+
+    // Every segment with file bytes needs exactly one block
+    for (int i = 0; i < c->elf.phnum; i++) {
+        const Elf64_Phdr *p = &c->elf.phdrs[i];
+        int blocks = 0;
+        for (uint32_t j = 0; j < c->nsegs; j++) {
+            blocks += c->segs[j].phdr == (uint32_t)i;
+        }
+        if (blocks != (p->p_type == PT_LOAD && p->p_filesz > 0)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+const struct lz4_image_segment *lz4_image_segment(const struct lz4_image *c, int index) {
+    for (uint32_t i = 0; i < c->nsegs; i++) {
+        if (c->segs[i].phdr == (uint32_t)index) {
+            return &c->segs[i];
+        }
+    }
+    return NULL;
+}
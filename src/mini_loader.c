@@ -1,43 +1,1567 @@
 #include "mini_loader.h"
+#include "crc32c.h"
+#include "dynlink.h"
+#include "elf_debug.h"
 #include "elf_format.h"
+#include "image_cache.h"
+#include "lz4.h"
+#include "lz4_image.h"
+#include "segment_crc.h"
 #include "syscalls.h"
+#include "threads.h"
 #include "utils.h"
 
-#define PAGE_SIZE 0x1000
+#define PAGE_SIZE page_size()
 #define PAGE_ALIGN_DOWN(x) ((x) & ~(PAGE_SIZE - 1))
 #define PAGE_ALIGN_UP(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
 
+// --fault-policy values: when segment pages become resident
+#define FAULT_LAZY 0        // pure demand paging
+#define FAULT_PREFAULT 1    // every segment resident before the jump
+#define FAULT_TEXT_ONLY 2   // only executable segments prefaulted
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define HUGE_ALIGN_DOWN(x) ((x) & ~(HUGE_PAGE_SIZE - 1))
+#define HUGE_ALIGN_UP(x) (((x) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1))
+
+// Segments are populated in chunks of this size when worker threads are
+// available; anything smaller than PARALLEL_MIN_SIZE is copied inline
+#define POPULATE_CHUNK_SIZE (2UL << 20)
+#define PARALLEL_MIN_SIZE (8UL << 20)
+
+// --symbol may be given this many times
+#define MAX_LOOKUP_SYMBOLS 64
+
+struct load_stats loader_stats;
+struct loaded_image loader_image;
+struct arena loader_arena;
+
+static int loader_mode = LOAD_MODE_COPY;
+static int apply_relocations = 1;
+static int huge_pages = 0;
+static int fault_policy = FAULT_LAZY;
+
+// The main image's path while it is mapped (NULL for shared libraries):
+// the inode key of the image cache and where a sidecar .crc is looked for
+static const char *image_path;
+
+// --cache: read-only segments of copy-mode loads come from the shared image
+// cache
+static int use_cache = 0;
+static struct image_cache image_cache = { .fd = -1 };
+static int cache_result = -1;
+
+// --verify: refuse a main image without segment checksums (stamped images
+// are always checked)
+static int verify_required = 0;
+
+// Hand-off before the jump (load_elf_from_path only: fork-server children
+// share these pages with the server, so unmapping them frees nothing)
+static int handoff_reclaim = 0;
+static int drop_loader = 0;      // --drop-loader: unmap the loader image too
+
+// Environment handed to the loaded program (set by main)
+static char **loader_envp;
+static const char *lookup_names[MAX_LOOKUP_SYMBOLS];
+static int nlookup_names = 0;
+static struct dynlink_config dynlink_cfg;
+
+// Startup phases timed when built with LOADER_TIMING (make TIMING=1) and
+// enabled with --timing or MINI_LOADER_TIMING=1 in the environment
+enum load_phase {
+    PHASE_OPEN,       // openat + lseek
+    PHASE_READ,       // reading the file (copy) or its headers (mmap)
+    PHASE_RESERVE,    // PROT_NONE reservation of the image span
+    PHASE_POPULATE,   // copying/zeroing or mmap'ing segment contents
+    PHASE_MPROTECT,   // per-segment protection changes (copy mode)
+    PHASE_VERIFY,     // CRC-32C of segment bytes (stamped images)
+    PHASE_RELOC,      // RELA/RELR relative relocations
+    PHASE_STACK,      // building the program's initial stack
+    PHASE_COUNT
+};
+
+#ifdef LOADER_TIMING
+static int timing_enabled = 0;
+static uint64_t phase_ticks[PHASE_COUNT];
+
+// Virtual counter: readable from EL0 without a syscall
+static inline uint64_t timing_now(void) {
+    uint64_t ticks;
+    __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0" : "=r"(ticks) : : "memory");
+    return ticks;
+}
+
+static inline uint64_t timing_stamp(void) {
+    return timing_enabled ? timing_now() : 0;
+}
+
+// Charge the time since *since to phase and restart the clock, so
+// back-to-back phases can share one stamp
+static inline void timing_add(enum load_phase phase, uint64_t *since) {
+    if (timing_enabled) {
+        uint64_t now = timing_now();
+        phase_ticks[phase] += now - *since;
+        *since = now;
+    }
+}
+
+// One line on stderr: "mini_loader_timing_ns open=... stack=... total=..."
+static void timing_report(void) {
+    if (!timing_enabled) {
+        return;
+    }
+
+    uint64_t freq;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+    if (freq == 0) {
+        return;
+    }
+
+    uint64_t ns[PHASE_COUNT];
+    uint64_t total = 0;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        uint64_t t = phase_ticks[i];
+        ns[i] = t / freq * 1000000000UL + t % freq * 1000000000UL / freq;
+        total += ns[i];
+    }
+
+    mini_eprintf("mini_loader_timing_ns open=%lu read=%lu reserve=%lu populate=%lu "
+                 "mprotect=%lu verify=%lu reloc=%lu stack=%lu total=%lu\n",
+                 ns[PHASE_OPEN], ns[PHASE_READ], ns[PHASE_RESERVE],
+                 ns[PHASE_POPULATE], ns[PHASE_MPROTECT], ns[PHASE_VERIFY], ns[PHASE_RELOC],
+                 ns[PHASE_STACK], total);
+}
+#else
+#define timing_stamp() 0
+#define timing_add(phase, since) ((void)(phase), (void)(since))
+#define timing_report() ((void)0)
+#endif
+
+// Convert ELF segment flags to mmap protection flags
+static int segment_prot(const Elf64_Phdr *phdr) {
+    int prot = 0;
+    if (phdr->p_flags & PF_R) prot |= PROT_READ;
+    if (phdr->p_flags & PF_W) prot |= PROT_WRITE;
+    if (phdr->p_flags & PF_X) prot |= PROT_EXEC;
+    return prot;
+}
+
+// Read exactly count bytes unless EOF or an error comes first
+static long read_full(int fd, void *buf, size_t count) {
+    size_t done = 0;
+    while (done < count) {
+        long n = sys_read(fd, (uint8_t *)buf + done, count - done);
+        if (n < 0) {
+            return n;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    loader_stats.bytes_read += done;
+    return done;
+}
+
+// elf_image has bounds-checked the file; the loader also needs an AArch64
+// executable or static PIE with something to load
+static int check_loadable(const struct elf_image *img) {
+    const Elf64_Ehdr *ehdr = img->ehdr;
+    if (ehdr->e_machine != EM_AARCH64 ||
+        (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) ||
+        img->phnum == 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Find the page-aligned span covered by all PT_LOAD segments
+static int load_range(const Elf64_Phdr *phdrs, int phnum,
+                      uintptr_t *out_min, uintptr_t *out_max) {
+    uintptr_t min_vaddr = UINTPTR_MAX;
+    uintptr_t max_vaddr = 0;
+
+    for (int i = 0; i < phnum; i++) {
+        if (phdrs[i].p_type != PT_LOAD) {
+            continue;
+        }
+        if (phdrs[i].p_filesz > phdrs[i].p_memsz) {
+            return -1;
+        }
+        if (phdrs[i].p_vaddr < min_vaddr) {
+            min_vaddr = phdrs[i].p_vaddr;
+        }
+        if (phdrs[i].p_vaddr + phdrs[i].p_memsz > max_vaddr) {
+            max_vaddr = phdrs[i].p_vaddr + phdrs[i].p_memsz;
+        }
+    }
+
+    if (min_vaddr >= max_vaddr) {
+        return -1;
+    }
+
+    *out_min = PAGE_ALIGN_DOWN(min_vaddr);
+    *out_max = PAGE_ALIGN_UP(max_vaddr);
+    return 0;
+}
+
+// Apply the image's relative relocations once every segment is in place
+static int relocate(const Elf64_Phdr *phdrs, int phnum, uintptr_t load_bias) {
+    if (!apply_relocations) {
+        return 0;
+    }
+    if (relocate_image(phdrs, phnum, load_bias, &loader_stats.reloc) < 0) {
+        mini_printf("Malformed relocation tables\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Checksums for the image being mapped: its stamped note, else the main
+// image's sidecar file. A stamped image whose note is out of reach or
+// malformed fails rather than falling back to the sidecar.
+// Returns 1 if found, 0 if there are none, -1 if the note could not be read
+static int find_checksums(const struct elf_image *img, struct segment_crc *sums) {
+    if (segment_crc_phdr(img) >= 0) {
+        if (segment_crc_from_image(img, sums) < 0) {
+            mini_printf("Unreadable segment checksum note\n");
+            return -1;
+        }
+        return 1;
+    }
+    if (image_path && strcmp(image_path, "-") != 0 &&
+        segment_crc_from_sidecar(image_path, sums) == 0) {
+        return 1;
+    }
+    return 0;
+}
+
+// Check every PT_LOAD's file bytes, now at their final address and before
+// relocation, against sums (NULL if the image has none). A segment without
+// read permission is made readable for the check.
+static int verify_segments(const Elf64_Phdr *phdrs, int phnum, uintptr_t load_bias,
+                           const struct segment_crc *sums) {
+    if (!sums) {
+        if (verify_required && image_path) {
+            mini_printf("No segment checksums: stamp the image with stamp_crc\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    uint64_t t = monotonic_ns();
+    for (int i = 0; i < phnum; i++) {
+        const Elf64_Phdr *p = &phdrs[i];
+        if (p->p_type != PT_LOAD || p->p_filesz == 0) {
+            continue;
+        }
+        int k = 0;
+        while (k < sums->count && sums->segs[k].phdr != (uint32_t)i) {
+            k++;
+        }
+        if (k == sums->count) {
+            mini_printf("Segment %d has no checksum\n", i);
+            return -1;
+        }
+
+        uintptr_t addr = p->p_vaddr + load_bias;
+        uintptr_t start = PAGE_ALIGN_DOWN(addr);
+        uintptr_t end = PAGE_ALIGN_UP(addr + p->p_filesz);
+        int prot = segment_prot(p);
+        if (!(prot & PROT_READ) &&
+            sys_mprotect((void *)start, end - start, prot | PROT_READ) < 0) {
+            mini_printf("mprotect failed for segment %d\n", i);
+            return -1;
+        }
+        uint32_t crc = crc32c(0, (const void *)addr, p->p_filesz);
+        if (!(prot & PROT_READ)) {
+            sys_mprotect((void *)start, end - start, prot);
+        }
+
+        if (crc != sums->segs[k].crc) {
+            mini_printf("Checksum mismatch in segment %d: %08x, expected %08x\n",
+                        i, crc, sums->segs[k].crc);
+            return -1;
+        }
+        loader_stats.verified++;
+        loader_stats.verify_bytes += p->p_filesz;
+    }
+    loader_stats.verify_ns += monotonic_ns() - t;
+    return 0;
+}
+
+// Reserve the whole image as PROT_NONE and return the load bias
+// ET_EXEC images are placed at their link address, PIEs wherever the OS likes.
+// With --huge, a PIE is placed so that its addresses are congruent to the
+// link addresses mod 2 MiB, which lines huge-page boundaries up with the
+// 2 MiB-aligned parts of its segments.
+static int reserve_image(const Elf64_Ehdr *ehdr, uintptr_t min_vaddr,
+                         uintptr_t max_vaddr, uintptr_t *out_bias) {
+    void *hint = NULL;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    size_t span = max_vaddr - min_vaddr;
+    size_t slack = 0;
+
+    if (ehdr->e_type == ET_EXEC) {
+        hint = (void *)min_vaddr;
+        flags |= MAP_FIXED;
+    } else if (ehdr->e_type != ET_DYN) {
+        return -1;
+    } else if (huge_pages && span >= HUGE_PAGE_SIZE) {
+        slack = HUGE_PAGE_SIZE;
+    }
+
+    void *raw = sys_mmap(hint, span + slack, PROT_NONE, flags, -1, 0);
+    if (raw == MAP_FAILED) {
+        return -1;
+    }
+
+    uintptr_t base = (uintptr_t)raw;
+    if (slack) {
+        // Pick the spot where bias is a multiple of 2 MiB, then give back
+        // the unused head and tail of the over-sized reservation
+        base = HUGE_ALIGN_UP((uintptr_t)raw - min_vaddr) + min_vaddr;
+        if (base > (uintptr_t)raw) {
+            sys_munmap(raw, base - (uintptr_t)raw);
+        }
+        uintptr_t end = (uintptr_t)raw + span + slack;
+        if (end > base + span) {
+            sys_munmap((void *)(base + span), end - (base + span));
+        }
+    }
+
+    *out_bias = base - min_vaddr;
+    return 0;
+}
+
+// Ask for transparent huge pages on the 2 MiB-aligned interior of a large
+// R-X or RW segment. Must happen before the segment is first touched.
+static void advise_huge(const Elf64_Phdr *phdr, uintptr_t load_bias) {
+    if (!huge_pages || phdr->p_memsz < HUGE_PAGE_SIZE ||
+        !(phdr->p_flags & (PF_X | PF_W))) {
+        return;
+    }
+
+    uintptr_t start = HUGE_ALIGN_UP(phdr->p_vaddr + load_bias);
+    uintptr_t end = HUGE_ALIGN_DOWN(phdr->p_vaddr + load_bias + phdr->p_memsz);
+    if (end > start && sys_madvise((void *)start, end - start, MADV_HUGEPAGE) == 0) {
+        loader_stats.huge_segments++;
+        loader_stats.huge_bytes += end - start;
+    }
+}
+
+// One PT_LOAD being populated: bytes below filesz come from src, those from
+// filesz up to end are zero-filled (both offsets from dst)
+struct populate_job {
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t filesz;
+    size_t end;
+};
+
+// Copy and/or zero chunk `index` of a segment
+static void populate_chunk(void *arg, size_t index) {
+    struct populate_job *job = arg;
+    size_t start = index * POPULATE_CHUNK_SIZE;
+    size_t end = start + POPULATE_CHUNK_SIZE;
+    if (end > job->end) {
+        end = job->end;
+    }
+
+    if (start < job->filesz) {
+        size_t copy_end = end < job->filesz ? end : job->filesz;
+        memcpy(job->dst + start, job->src + start, copy_end - start);
+        start = copy_end;
+    }
+    if (start < end) {
+        memset(job->dst + start, 0, end - start);
+    }
+}
+
+// Fill a segment with its file bytes and zero zero_len bytes after them,
+// split across the thread pool when the segment is large enough
+static void populate_segment(uint8_t *dst, const uint8_t *src,
+                             size_t filesz, size_t zero_len) {
+    struct populate_job job = { dst, src, filesz, filesz + zero_len };
+    size_t chunks = (job.end + POPULATE_CHUNK_SIZE - 1) / POPULATE_CHUNK_SIZE;
+
+    if (thread_pool_size() > 1 && job.end >= PARALLEL_MIN_SIZE) {
+        thread_pool_run(populate_chunk, &job, chunks);
+    } else {
+        for (size_t i = 0; i < chunks; i++) {
+            populate_chunk(&job, i);
+        }
+    }
+
+    loader_stats.bytes_copied += filesz;
+    loader_stats.bytes_zeroed += zero_len;
+}
+
+// Whether the fault policy wants this segment resident before the jump
+static int should_prefault(const Elf64_Phdr *phdr) {
+    return fault_policy == FAULT_PREFAULT ||
+           (fault_policy == FAULT_TEXT_ONLY && (phdr->p_flags & PF_X));
+}
+
+// Make [start, end) resident and writable-faulted ahead of time
+// MADV_POPULATE_WRITE needs Linux 5.14; fall back to touching each page
+static void prefault_range(uintptr_t start, uintptr_t end) {
+    if (end <= start ||
+        sys_madvise((void *)start, end - start, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+    for (uintptr_t p = start; p < end; p += PAGE_SIZE) {
+        *(volatile uint8_t *)p = 0;
+    }
+}
+
 void *read_file_into_memory(const char *path, size_t *size) {
-    // Your solution here!
+    uint64_t t = timing_stamp();
     int fd = sys_openat(AT_FDCWD, path, O_RDONLY);
     if (fd < 0) {
         mini_printf("Could not open file\n");
-        return -1;
+        return NULL;
     }
 
-    size_t size = sys_lseek(fd, 0, SEEK_END);
-    if (size < 0) {
+    long file_size = sys_lseek(fd, 0, SEEK_END);
+    if (file_size <= 0 || sys_lseek(fd, 0, SEEK_SET) < 0) {
         mini_printf("Error during lseek\n");
+        sys_close(fd);
+        return NULL;
+    }
+    timing_add(PHASE_OPEN, &t);
+
+    struct arena_mark mark = arena_mark(&loader_arena);
+    void *data = arena_alloc(&loader_arena, file_size, PAGE_SIZE);
+    if (!data) {
+        mini_printf("Could not allocate file buffer\n");
+        sys_close(fd);
+        return NULL;
+    }
+
+    if (read_full(fd, data, file_size) != file_size) {
+        mini_printf("Short read on file\n");
+        arena_reset(&loader_arena, mark);
+        sys_close(fd);
+        return NULL;
+    }
+
+    sys_close(fd);
+    timing_add(PHASE_READ, &t);
+    *size = file_size;
+    loader_stats.file_size = file_size;
+    return data;
+}
+
+// Decompress segment index of a container into dst, then zero zero_len
+// bytes after its file bytes
+static int unpack_segment(const struct lz4_image *c, int index, uint8_t *dst,
+                          size_t zero_len) {
+    const Elf64_Phdr *phdr = &c->elf.phdrs[index];
+    const struct lz4_image_segment *seg = lz4_image_segment(c, index);
+    if (seg) {
+        uint64_t start = monotonic_ns();
+        long n = lz4_decompress(c->data + seg->offset, seg->size, dst, phdr->p_filesz);
+        if (n < 0 || (uint64_t)n != phdr->p_filesz) {
+            return -1;
+        }
+        loader_stats.lz4_ns += monotonic_ns() - start;
+        loader_stats.lz4_packed += seg->size;
+        loader_stats.lz4_unpacked += n;
+    }
+    memset(dst + phdr->p_filesz, 0, zero_len);
+    loader_stats.bytes_zeroed += zero_len;
+    return 0;
+}
+
+// A container keeps no file copy of PT_DYNAMIC, so point img at the
+// mapped one for relocation, symbol lookup and dynlink
+// Returns 0 if there is none or it lies in a segment's file bytes and ends
+// in DT_NULL, -1 otherwise
+static int use_mapped_dynamic(struct elf_image *img, uintptr_t load_bias) {
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *dyn_phdr = &img->phdrs[i];
+        if (dyn_phdr->p_type != PT_DYNAMIC) {
+            continue;
+        }
+        for (int j = 0; j < img->phnum; j++) {
+            const Elf64_Phdr *p = &img->phdrs[j];
+            if (p->p_type != PT_LOAD || dyn_phdr->p_vaddr < p->p_vaddr ||
+                dyn_phdr->p_vaddr - p->p_vaddr > p->p_filesz ||
+                dyn_phdr->p_filesz > p->p_filesz - (dyn_phdr->p_vaddr - p->p_vaddr)) {
+                continue;
+            }
+            const Elf64_Dyn *dyn = (const Elf64_Dyn *)(dyn_phdr->p_vaddr + load_bias);
+            size_t count = dyn_phdr->p_filesz / sizeof(Elf64_Dyn);
+            for (size_t n = 0; n < count; n++) {
+                if (dyn[n].d_tag == DT_NULL) {
+                    img->dynamic = dyn;
+                    img->dynnum = n + 1;
+                    return 0;
+                }
+            }
+        }
         return -1;
     }
+    return 0;
 }
 
 uintptr_t map_elf(void *elf_data, size_t size) {
-    // Your solution here!
+    struct elf_image img;
+    struct lz4_image packed;
+    int is_packed = lz4_image_detect(elf_data, size);
+    if (is_packed) {
+        if (lz4_image_open(&packed, elf_data, size) < 0 ||
+            check_loadable(&packed.elf) < 0) {
+            mini_printf("Invalid LZ4 image\n");
+            return 0;
+        }
+        img = packed.elf;
+    } else if (elf_image_from_memory(&img, elf_data, size) < 0 ||
+               check_loadable(&img) < 0) {
+        mini_printf("Invalid ELF file\n");
+        return 0;
+    }
+
+    const Elf64_Ehdr *ehdr = img.ehdr;
+    const Elf64_Phdr *phdrs = img.phdrs;
+
+    // Staging copies segment bytes out of the file, which a container
+    // only has compressed
+    if (use_cache && image_path && !is_packed) {
+        cache_result = image_cache_open(&image_cache, &img, image_path);
+    }
+
+    uint64_t t = timing_stamp();
+    uintptr_t min_vaddr, max_vaddr, load_bias;
+    if (load_range(phdrs, img.phnum, &min_vaddr, &max_vaddr) < 0 ||
+        reserve_image(ehdr, min_vaddr, max_vaddr, &load_bias) < 0) {
+        mini_printf("Could not reserve image\n");
+        return 0;
+    }
+    timing_add(PHASE_RESERVE, &t);
+
+    for (int i = 0; i < img.phnum; i++) {
+        const Elf64_Phdr *phdr = &phdrs[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+
+        uintptr_t seg_addr = phdr->p_vaddr + load_bias;
+        uintptr_t seg_start = PAGE_ALIGN_DOWN(seg_addr);
+        uintptr_t seg_end = PAGE_ALIGN_UP(seg_addr + phdr->p_memsz);
+
+        // Cached pages already hold file bytes and zeroed BSS; MAP_PRIVATE
+        // keeps them shared with every other load until someone writes
+        long cache_offset = image_cache_segment(&image_cache, i);
+        if (cache_offset >= 0) {
+            int populate = should_prefault(phdr) ? MAP_POPULATE : 0;
+            if (sys_mmap((void *)seg_start, seg_end - seg_start, segment_prot(phdr),
+                         MAP_PRIVATE | MAP_FIXED | populate,
+                         image_cache.fd, cache_offset) == MAP_FAILED) {
+                mini_printf("mmap from image cache failed for segment %d\n", i);
+                image_cache_close(&image_cache);
+                return 0;
+            }
+            loader_stats.bytes_shared += seg_end - seg_start;
+            timing_add(PHASE_POPULATE, &t);
+            continue;
+        }
+
+        if (sys_mprotect((void *)seg_start, seg_end - seg_start,
+                         PROT_READ | PROT_WRITE) < 0) {
+            mini_printf("mprotect failed for segment %d\n", i);
+            return 0;
+        }
+        timing_add(PHASE_MPROTECT, &t);
+        advise_huge(phdr, load_bias);
+
+        // Copy file bytes and zero-fill the BSS that shares their last page;
+        // the rest of the BSS is still untouched zero memory from the
+        // reservation and only needs touching if the fault policy says so
+        uintptr_t file_end = seg_addr + phdr->p_filesz;
+        uintptr_t mem_end = seg_addr + phdr->p_memsz;
+        uintptr_t zero_end = PAGE_ALIGN_UP(file_end) < mem_end ?
+                             PAGE_ALIGN_UP(file_end) : mem_end;
+        if (!is_packed) {
+            populate_segment((uint8_t *)seg_addr,
+                             (uint8_t *)elf_data + phdr->p_offset,
+                             phdr->p_filesz, zero_end - file_end);
+        } else if (unpack_segment(&packed, i, (uint8_t *)seg_addr,
+                                  zero_end - file_end) < 0) {
+            mini_printf("Corrupt LZ4 block for segment %d\n", i);
+            return 0;
+        }
+        if (should_prefault(phdr)) {
+            prefault_range(PAGE_ALIGN_UP(zero_end), seg_end);
+        }
+        timing_add(PHASE_POPULATE, &t);
+
+        if (sys_mprotect((void *)seg_start, seg_end - seg_start,
+                         segment_prot(phdr)) < 0) {
+            mini_printf("mprotect failed for segment %d\n", i);
+            return 0;
+        }
+        timing_add(PHASE_MPROTECT, &t);
+    }
+    // The mappings hold their own reference to the entry
+    image_cache_close(&image_cache);
+
+    struct segment_crc sums;
+    int have_sums = find_checksums(&img, &sums);
+    if (have_sums < 0 ||
+        verify_segments(phdrs, img.phnum, load_bias, have_sums ? &sums : NULL) < 0) {
+        return 0;
+    }
+    timing_add(PHASE_VERIFY, &t);
+
+    if (is_packed && use_mapped_dynamic(&img, load_bias) < 0) {
+        mini_printf("Malformed dynamic section\n");
+        return 0;
+    }
+    if (relocate(phdrs, img.phnum, load_bias) < 0) {
+        return 0;
+    }
+    timing_add(PHASE_RELOC, &t);
+
+    // The file buffer stays in loader_arena, so the view remains valid
+    loaded_image_init(&loader_image, &img, load_bias, &loader_arena);
+    return ehdr->e_entry + load_bias;
+}
+
+// Streaming loads (LOAD_MODE_STREAM) read their input strictly forward:
+// the header prefix, then every PT_LOAD in p_offset order, discarding the
+// gaps. Bytes a segment needs that were already consumed (the headers in
+// the first PT_LOAD, file ranges shared by two segments) are copied from
+// wherever they landed.
+struct stream {
+    int fd;
+    uint64_t pos;                // bytes consumed
+    const uint8_t *prefix;       // file bytes [0, prefix_len)
+    size_t prefix_len;
+    uint8_t *skip_buf;           // STREAM_SKIP_SIZE bytes for discarding
+    const Elf64_Phdr *phdrs;
+    const int *loaded;           // phdr indices already read, in order
+    int nloaded;
+    uintptr_t load_bias;
+};
+
+// Largest header prefix (ELF header up to the end of the program headers)
+// a stream may have, and the discard buffer size
+#define STREAM_PREFIX_MAX (1UL << 20)
+#define STREAM_SKIP_SIZE (64UL << 10)
+
+// Discard the stream up to offset
+static int stream_skip(struct stream *st, uint64_t offset) {
+    while (st->pos < offset) {
+        size_t n = offset - st->pos < STREAM_SKIP_SIZE ?
+                   offset - st->pos : STREAM_SKIP_SIZE;
+        if (read_full(st->fd, st->skip_buf, n) != (long)n) {
+            return -1;
+        }
+        loader_stats.bytes_skipped += n;
+        st->pos += n;
+    }
+    return 0;
 }
 
-void load_elf_from_path(const char *path) {
-    // Your solution here!
+// Copy file bytes [offset, offset + len), all before st->pos, from the
+// prefix or a segment loaded earlier
+static int stream_copy_consumed(const struct stream *st, uint8_t *dst,
+                                uint64_t offset, uint64_t len) {
+    while (len > 0) {
+        const uint8_t *src = NULL;
+        uint64_t avail = 0;
+        if (offset < st->prefix_len) {
+            src = st->prefix + offset;
+            avail = st->prefix_len - offset;
+        }
+        for (int i = 0; i < st->nloaded && !src; i++) {
+            const Elf64_Phdr *p = &st->phdrs[st->loaded[i]];
+            if (offset >= p->p_offset && offset - p->p_offset < p->p_filesz) {
+                src = (const uint8_t *)(p->p_vaddr + st->load_bias) + (offset - p->p_offset);
+                avail = p->p_filesz - (offset - p->p_offset);
+            }
+        }
+        if (!src) {
+            return -1;
+        }
+        uint64_t n = len < avail ? len : avail;
+        memcpy(dst, src, n);
+        loader_stats.bytes_copied += n;
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+    return 0;
 }
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        mini_printf("Usage: %s <elf_file>\n", argv[0]);
-        return 1;
+// Bring one segment's file bytes in from the stream
+static int stream_segment(struct stream *st, const Elf64_Phdr *phdr) {
+    uint8_t *dst = (uint8_t *)(phdr->p_vaddr + st->load_bias);
+    uint64_t end = phdr->p_offset + phdr->p_filesz;
+
+    if (phdr->p_offset < st->pos) {
+        uint64_t len = (end < st->pos ? end : st->pos) - phdr->p_offset;
+        if (stream_copy_consumed(st, dst, phdr->p_offset, len) < 0) {
+            return -1;
+        }
+    }
+    if (end > st->pos) {
+        if (stream_skip(st, phdr->p_offset) < 0) {
+            return -1;
+        }
+        uint64_t len = end - st->pos;
+        if (read_full(st->fd, dst + (st->pos - phdr->p_offset), len) != (long)len) {
+            return -1;
+        }
+        st->pos = end;
+    }
+    return 0;
+}
+
+// Checksums for a streamed image. stamp_crc appends the note after every
+// segment, so it is still ahead in the stream; a sidecar works as well.
+// A note that was already read past or does not parse fails the load, as
+// it would from a file.
+// Returns 1 if found, 0 if there are none, -1 if the note could not be read
+static int stream_checksums(struct stream *st, const struct elf_image *img,
+                            struct segment_crc *sums) {
+    int index = segment_crc_phdr(img);
+    const Elf64_Phdr *p = index >= 0 ? &img->phdrs[index] : NULL;
+    if (!p || p->p_offset < st->pos || p->p_filesz > STREAM_SKIP_SIZE) {
+        // No note: the sidecar. A note out of the stream's reach is only
+        // found if it lies in the header prefix
+        return find_checksums(img, sums);
+    }
+    if (stream_skip(st, p->p_offset) < 0 ||
+        read_full(st->fd, st->skip_buf, p->p_filesz) != (long)p->p_filesz) {
+        mini_printf("Stream ended before the checksum note\n");
+        return -1;
+    }
+    st->pos += p->p_filesz;
+    if (segment_crc_parse(st->skip_buf, p->p_filesz, sums) < 0) {
+        mini_printf("Unreadable segment checksum note\n");
+        return -1;
+    }
+    return 1;
+}
+
+uintptr_t map_elf_stream(int fd) {
+    struct stream st;
+    memset(&st, 0, sizeof(st));
+    st.fd = fd;
+
+    // ELF header, then everything up to the end of the program headers
+    uint64_t t = timing_stamp();
+    Elf64_Ehdr ehdr;
+    if (read_full(fd, &ehdr, sizeof(ehdr)) != (long)sizeof(ehdr)) {
+        mini_printf("Short read on ELF header\n");
+        return 0;
+    }
+    if (lz4_image_detect(&ehdr, sizeof(ehdr))) {
+        mini_printf("LZ4 images cannot be streamed\n");
+        return 0;
+    }
+    uint64_t prefix_len = ehdr.e_phoff + (uint64_t)ehdr.e_phnum * sizeof(Elf64_Phdr);
+    if (ehdr.e_phoff < sizeof(ehdr) || ehdr.e_phoff > STREAM_PREFIX_MAX ||
+        prefix_len > STREAM_PREFIX_MAX) {
+        mini_printf("Program headers are not near the start of the stream\n");
+        return 0;
+    }
+    uint8_t *prefix = arena_alloc(&loader_arena, prefix_len, 16);
+    st.skip_buf = arena_alloc(&loader_arena, STREAM_SKIP_SIZE, 16);
+    int *order = ARENA_ARRAY(&loader_arena, int, ehdr.e_phnum);
+    if (!prefix || !st.skip_buf || !order) {
+        mini_printf("Could not allocate stream buffers\n");
+        return 0;
+    }
+    memcpy(prefix, &ehdr, sizeof(ehdr));
+    uint64_t rest = prefix_len - sizeof(ehdr);
+    if (read_full(fd, prefix + sizeof(ehdr), rest) != (long)rest) {
+        mini_printf("Short read on program headers\n");
+        return 0;
+    }
+    st.prefix = prefix;
+    st.prefix_len = st.pos = prefix_len;
+    loader_stats.file_size = prefix_len;
+    timing_add(PHASE_READ, &t);
+
+    struct elf_image img;
+    if (elf_image_from_headers(&img, prefix, prefix_len) < 0 ||
+        check_loadable(&img) < 0) {
+        mini_printf("Invalid ELF file\n");
+        return 0;
     }
+    const Elf64_Phdr *phdrs = img.phdrs;
+    st.phdrs = phdrs;
+    st.loaded = order;
 
-    load_elf_from_path(argv[1]);
+    uintptr_t min_vaddr, max_vaddr, load_bias;
+    if (load_range(phdrs, img.phnum, &min_vaddr, &max_vaddr) < 0 ||
+        reserve_image(img.ehdr, min_vaddr, max_vaddr, &load_bias) < 0) {
+        mini_printf("Could not reserve image\n");
+        return 0;
+    }
+    st.load_bias = load_bias;
+    timing_add(PHASE_RESERVE, &t);
+
+    // PT_LOADs by file offset (insertion sort: there are only a handful)
+    int nload = 0;
+    for (int i = 0; i < img.phnum; i++) {
+        if (phdrs[i].p_type != PT_LOAD) {
+            continue;
+        }
+        int j = nload++;
+        while (j > 0 && phdrs[order[j - 1]].p_offset > phdrs[i].p_offset) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    // Segments stay writable until all of them are in: a later one may
+    // copy consumed bytes out of an earlier one
+    for (int k = 0; k < nload; k++) {
+        int i = order[k];
+        const Elf64_Phdr *phdr = &phdrs[i];
+        uintptr_t seg_addr = phdr->p_vaddr + load_bias;
+        uintptr_t seg_start = PAGE_ALIGN_DOWN(seg_addr);
+        uintptr_t seg_end = PAGE_ALIGN_UP(seg_addr + phdr->p_memsz);
+
+        if (sys_mprotect((void *)seg_start, seg_end - seg_start,
+                         PROT_READ | PROT_WRITE) < 0) {
+            mini_printf("mprotect failed for segment %d\n", i);
+            return 0;
+        }
+        timing_add(PHASE_MPROTECT, &t);
+        advise_huge(phdr, load_bias);
+
+        if (stream_segment(&st, phdr) < 0) {
+            mini_printf("Stream ended inside segment %d\n", i);
+            return 0;
+        }
+        st.nloaded++;
+
+        uintptr_t file_end = seg_addr + phdr->p_filesz;
+        uintptr_t mem_end = seg_addr + phdr->p_memsz;
+        uintptr_t zero_end = PAGE_ALIGN_UP(file_end) < mem_end ?
+                             PAGE_ALIGN_UP(file_end) : mem_end;
+        memset((void *)file_end, 0, zero_end - file_end);
+        loader_stats.bytes_zeroed += zero_end - file_end;
+        if (should_prefault(phdr)) {
+            prefault_range(PAGE_ALIGN_UP(zero_end), seg_end);
+        }
+        timing_add(PHASE_POPULATE, &t);
+    }
+
+    struct segment_crc sums;
+    int have_sums = stream_checksums(&st, &img, &sums);
+    if (have_sums < 0) {
+        return 0;
+    }
+    loader_stats.file_size = st.pos;
+
+    for (int i = 0; i < img.phnum; i++) {
+        const Elf64_Phdr *phdr = &phdrs[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+        uintptr_t seg_addr = phdr->p_vaddr + load_bias;
+        uintptr_t seg_start = PAGE_ALIGN_DOWN(seg_addr);
+        uintptr_t seg_end = PAGE_ALIGN_UP(seg_addr + phdr->p_memsz);
+        if (sys_mprotect((void *)seg_start, seg_end - seg_start,
+                         segment_prot(phdr)) < 0) {
+            mini_printf("mprotect failed for segment %d\n", i);
+            return 0;
+        }
+    }
+    timing_add(PHASE_MPROTECT, &t);
+
+    if (verify_segments(phdrs, img.phnum, load_bias, have_sums ? &sums : NULL) < 0) {
+        return 0;
+    }
+    timing_add(PHASE_VERIFY, &t);
+
+    // Only the header prefix was kept: PT_DYNAMIC comes from the mapping
+    if (use_mapped_dynamic(&img, load_bias) < 0) {
+        mini_printf("Malformed dynamic section\n");
+        return 0;
+    }
+    if (relocate(phdrs, img.phnum, load_bias) < 0) {
+        return 0;
+    }
+    timing_add(PHASE_RELOC, &t);
+
+    loaded_image_init(&loader_image, &img, load_bias, &loader_arena);
+    return img.ehdr->e_entry + load_bias;
+}
+
+// Map one PT_LOAD straight from the file with MAP_PRIVATE|MAP_FIXED
+// File pages cover [p_vaddr, p_vaddr + p_filesz); the tail of the last
+// file page is cleared by hand and whole BSS pages are fresh anonymous memory
+static int map_segment_from_fd(int fd, const Elf64_Phdr *phdr, uintptr_t load_bias) {
+    int prot = segment_prot(phdr);
+    uintptr_t seg_addr = phdr->p_vaddr + load_bias;
+    uintptr_t file_end = seg_addr + phdr->p_filesz;
+    uintptr_t mem_end = seg_addr + phdr->p_memsz;
+    uintptr_t map_start = PAGE_ALIGN_DOWN(seg_addr);
+    uintptr_t map_end = PAGE_ALIGN_UP(file_end);
+    int partial_bss = phdr->p_filesz > 0 && phdr->p_memsz > phdr->p_filesz &&
+                      PAGE_ALIGN_DOWN(file_end) != file_end;
+    int populate = should_prefault(phdr) ? MAP_POPULATE : 0;
+
+    if (phdr->p_filesz > 0) {
+        // mmap needs the file offset and the address to agree mod PAGE_SIZE
+        if ((phdr->p_vaddr - phdr->p_offset) & (PAGE_SIZE - 1)) {
+            return -1;
+        }
+
+        int map_prot = partial_bss ? (prot | PROT_WRITE) : prot;
+        void *seg = sys_mmap((void *)map_start, map_end - map_start, map_prot,
+                             MAP_PRIVATE | MAP_FIXED | populate, fd,
+                             PAGE_ALIGN_DOWN(phdr->p_offset));
+        if (seg == MAP_FAILED) {
+            return -1;
+        }
+        loader_stats.bytes_mapped += map_end - map_start;
+    } else {
+        map_end = map_start;
+    }
+
+    if (partial_bss) {
+        memset((void *)file_end, 0, map_end - file_end);
+        loader_stats.bytes_zeroed += map_end - file_end;
+        if (!(prot & PROT_WRITE) &&
+            sys_mprotect((void *)map_start, map_end - map_start, prot) < 0) {
+            return -1;
+        }
+    }
+
+    if (PAGE_ALIGN_UP(mem_end) > map_end) {
+        void *bss = sys_mmap((void *)map_end, PAGE_ALIGN_UP(mem_end) - map_end,
+                             prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | populate,
+                             -1, 0);
+        if (bss == MAP_FAILED) {
+            return -1;
+        }
+    }
 
-    // Should never reach here
     return 0;
 }
+
+uintptr_t map_elf_image_from_fd(int fd, struct loaded_image *image) {
+    struct elf_image img;
+
+    // The file is mapped read-only just to look at its headers; segment
+    // bytes are mapped again below at their final addresses
+    uint64_t t = timing_stamp();
+    if (elf_image_from_fd(&img, fd) < 0) {
+        mini_printf("Invalid ELF file\n");
+        return 0;
+    }
+    timing_add(PHASE_READ, &t);
+
+    const Elf64_Ehdr *ehdr = img.ehdr;
+    const Elf64_Phdr *phdrs = img.phdrs;
+    if (check_loadable(&img) < 0) {
+        mini_printf("Invalid ELF file\n");
+        elf_image_close(&img);
+        return 0;
+    }
+
+    uintptr_t min_vaddr, max_vaddr, load_bias;
+    if (load_range(phdrs, img.phnum, &min_vaddr, &max_vaddr) < 0 ||
+        reserve_image(ehdr, min_vaddr, max_vaddr, &load_bias) < 0) {
+        mini_printf("Could not reserve image\n");
+        goto out;
+    }
+    timing_add(PHASE_RESERVE, &t);
+
+    for (int i = 0; i < img.phnum; i++) {
+        if (phdrs[i].p_type != PT_LOAD) {
+            continue;
+        }
+        if (map_segment_from_fd(fd, &phdrs[i], load_bias) < 0) {
+            mini_printf("Could not map segment %d from file\n", i);
+            goto out;
+        }
+        advise_huge(&phdrs[i], load_bias);
+    }
+    timing_add(PHASE_POPULATE, &t);
+
+    struct segment_crc sums;
+    int have_sums = find_checksums(&img, &sums);
+    if (have_sums < 0 ||
+        verify_segments(phdrs, img.phnum, load_bias, have_sums ? &sums : NULL) < 0) {
+        goto out;
+    }
+    timing_add(PHASE_VERIFY, &t);
+
+    if (relocate(phdrs, img.phnum, load_bias) < 0) {
+        goto out;
+    }
+    timing_add(PHASE_RELOC, &t);
+
+    // The image keeps the read-only file mapping for .symtab lookups
+    loaded_image_init(image, &img, load_bias, &loader_arena);
+    return ehdr->e_entry + load_bias;
+out:
+    elf_image_close(&img);
+    return 0;
+}
+
+uintptr_t map_elf_from_fd(int fd) {
+    uintptr_t entry = map_elf_image_from_fd(fd, &loader_image);
+    if (entry) {
+        loader_stats.file_size = loader_image.file.size;
+    }
+    return entry;
+}
+
+static const char *fault_policy_name(int policy) {
+    switch (policy) {
+        case FAULT_PREFAULT:  return "prefault";
+        case FAULT_TEXT_ONLY: return "text-only";
+        default:              return "lazy";
+    }
+}
+
+// Print how the segment bytes got into memory
+static void print_load_stats(void) {
+    mini_printf("Load mode: %s\n",
+                loader_mode == LOAD_MODE_MMAP ? "mmap" :
+                loader_mode == LOAD_MODE_STREAM ? "stream" : "copy");
+    mini_printf("Threads: %d\n", loader_stats.threads);
+    mini_printf("Page size: %lu\n", page_size());
+    mini_printf("Fault policy: %s, %ld minor / %ld major faults during load\n",
+                fault_policy_name(fault_policy),
+                loader_stats.minor_faults, loader_stats.major_faults);
+    if (huge_pages) {
+        mini_printf("Huge pages: %d segments, %lu bytes advised\n",
+                    loader_stats.huge_segments, loader_stats.huge_bytes);
+    }
+    mini_printf("Bytes read: %lu\n", loader_stats.bytes_read);
+    mini_printf("Bytes copied: %lu\n", loader_stats.bytes_copied);
+    mini_printf("Bytes zeroed: %lu\n", loader_stats.bytes_zeroed);
+    mini_printf("Bytes mapped from file: %lu\n", loader_stats.bytes_mapped);
+    if (loader_mode == LOAD_MODE_STREAM) {
+        mini_printf("Bytes skipped: %lu\n", loader_stats.bytes_skipped);
+    }
+    if (loader_stats.lz4_packed) {
+        size_t ratio = loader_stats.lz4_unpacked * 100 / loader_stats.lz4_packed;
+        uint64_t ns = loader_stats.lz4_ns ? loader_stats.lz4_ns : 1;
+        mini_printf("LZ4: %lu -> %lu bytes (%lu.%02lux), %lu MB/s\n",
+                    loader_stats.lz4_packed, loader_stats.lz4_unpacked,
+                    ratio / 100, ratio % 100, loader_stats.lz4_unpacked * 1000 / ns);
+    }
+    if (use_cache && loader_mode == LOAD_MODE_COPY) {
+        mini_printf("Image cache: %s %s, %lu bytes mapped shared\n",
+                    cache_result < 0 ? "unavailable" :
+                    image_cache.staged ? "staged" : "hit",
+                    image_cache.key[0] ? image_cache.key : "-",
+                    loader_stats.bytes_shared);
+    }
+    if (loader_stats.verified) {
+        uint64_t ns = loader_stats.verify_ns ? loader_stats.verify_ns : 1;
+        mini_printf("Verify: %d segments, %lu bytes, %lu us, %lu MB/s (%s)\n",
+                    loader_stats.verified, loader_stats.verify_bytes,
+                    loader_stats.verify_ns / 1000,
+                    loader_stats.verify_bytes * 1000 / ns, crc32c_impl());
+    }
+    if (apply_relocations) {
+        const struct reloc_stats *r = &loader_stats.reloc;
+        mini_printf("Relocations: %lu RELA, %lu RELR, %lu unchanged, %lu pages written, %lu us\n",
+                    r->rela, r->relr, r->unchanged, r->pages, r->ns / 1000);
+        if (r->unsupported) {
+            mini_printf("Warning: %lu relocations of unsupported types skipped\n",
+                        r->unsupported);
+        }
+    }
+    dynlink_print_stats();
+    arena_print_stats("loader", &loader_arena);
+}
+
+// Resolve the --symbol names in the image that was just mapped
+static void print_symbols(void) {
+    uintptr_t addrs[MAX_LOOKUP_SYMBOLS];
+    loader_lookup_symbols(&loader_image, lookup_names, nlookup_names, addrs);
+    for (int i = 0; i < nlookup_names; i++) {
+        if (addrs[i]) {
+            mini_printf("Symbol %s: %p\n", lookup_names[i], (void *)addrs[i]);
+        } else {
+            mini_printf("Symbol %s: not found\n", lookup_names[i]);
+        }
+    }
+}
+
+uintptr_t load_image(const char *path) {
+    uintptr_t entry = 0;
+    int mode = loader_mode;
+    struct rusage before, after;
+
+    sys_getrusage(RUSAGE_SELF, &before);
+
+    mini_printf("Loading ELF: %s\n", path);
+    image_path = path;
+
+    if (mode == LOAD_MODE_STREAM) {
+        uint64_t t = timing_stamp();
+        int fd = strcmp(path, "-") == 0 ? 0 : sys_openat(AT_FDCWD, path, O_RDONLY);
+        if (fd < 0) {
+            mini_printf("Could not open file\n");
+            return 0;
+        }
+        timing_add(PHASE_OPEN, &t);
+        entry = map_elf_stream(fd);
+        if (fd != 0) {
+            sys_close(fd);
+        } else {
+            // The rest of the image (section headers, trailing data) is
+            // still unread in stdin; the program gets /dev/null instead of
+            // those bytes
+            int null_fd = sys_openat(AT_FDCWD, "/dev/null", O_RDONLY);
+            if (null_fd > 0) {
+                sys_dup3(null_fd, 0, 0);
+                sys_close(null_fd);
+            } else {
+                sys_close(0);
+            }
+        }
+    } else if (mode == LOAD_MODE_MMAP) {
+        uint64_t t = timing_stamp();
+        int fd = sys_openat(AT_FDCWD, path, O_RDONLY);
+        if (fd < 0) {
+            mini_printf("Could not open file\n");
+            return 0;
+        }
+        timing_add(PHASE_OPEN, &t);
+
+        // A container cannot be mapped segment by segment: unpack it instead
+        char magic[sizeof(LZ4_IMAGE_MAGIC) - 1];
+        if (sys_read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+            memcmp(magic, LZ4_IMAGE_MAGIC, sizeof(magic)) == 0) {
+            mini_printf("LZ4 image: unpacking instead of mapping\n");
+            sys_close(fd);
+            mode = LOAD_MODE_COPY;
+        } else {
+            entry = map_elf_from_fd(fd);
+            // The mappings hold their own reference to the file
+            sys_close(fd);
+        }
+    }
+    if (mode == LOAD_MODE_COPY) {
+        size_t size;
+        void *elf_data = read_file_into_memory(path, &size);
+        if (!elf_data) {
+            return 0;
+        }
+        mini_printf("File loaded: %lu bytes\n", size);
+        entry = map_elf(elf_data, size);
+    }
+
+    // Shared libraries and symbol relocations, once the image is in place
+    image_path = NULL;
+    if (entry && apply_relocations && dynlink_load(&loader_image, &dynlink_cfg) < 0) {
+        entry = 0;
+    }
+
+    // Workers are only needed while segments are populated
+    loader_stats.threads = thread_pool_size();
+    thread_pool_shutdown();
+
+    sys_getrusage(RUSAGE_SELF, &after);
+    loader_stats.minor_faults = after.ru_minflt - before.ru_minflt;
+    loader_stats.major_faults = after.ru_majflt - before.ru_majflt;
+
+    if (!entry) {
+        mini_printf("Failed to map ELF\n");
+        return 0;
+    }
+
+    print_load_stats();
+    print_symbols();
+    mini_printf("Entry point: %p\n", (void *)entry);
+    return entry;
+}
+
+#ifndef AT_MINSIGSTKSZ
+#define AT_MINSIGSTKSZ 51
+#endif
+
+// Entries copied from the loader's own auxiliary vector: CPU features
+// (NEON/SVE/LSE and friends live in HWCAP/HWCAP2), the vDSO, credentials
+// and the signal stack size the kernel needs for SVE state
+static const unsigned long forwarded_auxv[] = {
+    AT_HWCAP, AT_HWCAP2, AT_SYSINFO_EHDR, AT_PLATFORM, AT_CLKTCK,
+    AT_MINSIGSTKSZ, AT_UID, AT_EUID, AT_GID, AT_EGID, AT_SECURE,
+};
+
+// Entries start_program() sets itself, plus AT_NULL
+#define OWN_AUXV_ENTRIES 9
+#define MAX_AUXV_ENTRIES \
+    (OWN_AUXV_ENTRIES + sizeof(forwarded_auxv) / sizeof(forwarded_auxv[0]))
+
+// Run-time address of the image's program headers: PT_PHDR if it has one,
+// else the part of a PT_LOAD that maps e_phoff
+static uintptr_t image_phdr_address(const struct loaded_image *li) {
+    const Elf64_Ehdr *ehdr = li->file.ehdr;
+    uint64_t size = (uint64_t)li->phnum * sizeof(Elf64_Phdr);
+
+    for (int i = 0; i < li->phnum; i++) {
+        if (li->phdrs[i].p_type == PT_PHDR) {
+            return li->phdrs[i].p_vaddr + li->load_bias;
+        }
+    }
+    for (int i = 0; i < li->phnum; i++) {
+        const Elf64_Phdr *phdr = &li->phdrs[i];
+        if (phdr->p_type == PT_LOAD && ehdr->e_phoff >= phdr->p_offset &&
+            ehdr->e_phoff - phdr->p_offset + size <= phdr->p_filesz) {
+            return phdr->p_vaddr + ehdr->e_phoff - phdr->p_offset + li->load_bias;
+        }
+    }
+    return 0;
+}
+
+// Fill auxv (at least MAX_AUXV_ENTRIES pairs) for the image in loader_image
+// random points at the 16 AT_RANDOM bytes; returns the number of pairs
+static size_t build_auxv(Elf64_auxv_t *auxv, uintptr_t entry, const char *execfn,
+                         const uint8_t *random) {
+    size_t n = 0;
+    uintptr_t phdr = image_phdr_address(&loader_image);
+
+    if (phdr) {
+        auxv[n++] = (Elf64_auxv_t){ AT_PHDR, { phdr } };
+        auxv[n++] = (Elf64_auxv_t){ AT_PHENT, { sizeof(Elf64_Phdr) } };
+        auxv[n++] = (Elf64_auxv_t){ AT_PHNUM, { loader_image.phnum } };
+    }
+    auxv[n++] = (Elf64_auxv_t){ AT_PAGESZ, { page_size() } };
+    // The loader maps the image itself, so as for a static executable
+    // there is no interpreter base
+    auxv[n++] = (Elf64_auxv_t){ AT_BASE, { 0 } };
+    auxv[n++] = (Elf64_auxv_t){ AT_ENTRY, { entry } };
+    auxv[n++] = (Elf64_auxv_t){ AT_RANDOM, { (uintptr_t)random } };
+    auxv[n++] = (Elf64_auxv_t){ AT_EXECFN, { (uintptr_t)execfn } };
+
+    // getauxval() reads a missing entry as 0 too, so zeros are not copied
+    for (size_t i = 0; i < sizeof(forwarded_auxv) / sizeof(forwarded_auxv[0]); i++) {
+        unsigned long value = auxv_get(forwarded_auxv[i]);
+        if (value) {
+            auxv[n++] = (Elf64_auxv_t){ forwarded_auxv[i], { value } };
+        }
+    }
+    auxv[n++] = (Elf64_auxv_t){ AT_NULL, { 0 } };
+    return n;
+}
+
+// Resident set size in KiB from /proc/self/statm, or -1
+static long resident_kb(void) {
+    char buf[128];
+    int fd = sys_openat(AT_FDCWD, "/proc/self/statm", O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    long n = sys_read(fd, buf, sizeof(buf) - 1);
+    sys_close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+
+    // "size resident shared text lib data dt", all in pages
+    const char *p = buf;
+    while (*p && *p != ' ') {
+        p++;
+    }
+    unsigned long pages = 0;
+    for (p++; *p >= '0' && *p <= '9'; p++) {
+        pages = pages * 10 + (*p - '0');
+    }
+    return pages * (page_size() / 1024);
+}
+
+// Free what only the load needed: the file buffer and scratch arena, the
+// file views of the image and its libraries
+// Returns whether the loader image may be dropped at the jump as well
+static int reclaim_loader_memory(void) {
+    if (dynlink_stats.lazy > 0) {
+        // The resolver reads the images' program headers from their files
+        mini_printf("Reclaim: skipped, %lu PLT slots still bind through the loader\n",
+                    dynlink_stats.lazy);
+        return 0;
+    }
+
+    long before = resident_kb();
+    dynlink_release();
+    loaded_image_close(&loader_image);
+    arena_release(&loader_arena);
+    mini_printf("Reclaim: RSS %ld kB -> %ld kB\n", before, resident_kb());
+    return drop_loader;
+}
+
+// The loader's own headers, provided by the linker
+extern const Elf64_Ehdr __ehdr_start;
+
+// Run-time range covering the loader's PT_LOAD segments
+static int loader_extent(uintptr_t *start, uintptr_t *end) {
+    const Elf64_Ehdr *ehdr = &__ehdr_start;
+    const Elf64_Phdr *phdrs = (const Elf64_Phdr *)((const uint8_t *)ehdr + ehdr->e_phoff);
+    uintptr_t min_vaddr, max_vaddr;
+    if (load_range(phdrs, ehdr->e_phnum, &min_vaddr, &max_vaddr) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_offset == 0) {
+            uintptr_t bias = (uintptr_t)ehdr - phdrs[i].p_vaddr;
+            *start = min_vaddr + bias;
+            *end = max_vaddr + bias;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Make code written through the data cache visible to instruction fetch
+static void sync_icache(uintptr_t start, uintptr_t end) {
+    uint64_t ctr;
+    __asm__ __volatile__("mrs %0, ctr_el0" : "=r"(ctr));
+    uintptr_t dline = 4UL << ((ctr >> 16) & 0xf);
+    uintptr_t iline = 4UL << (ctr & 0xf);
+
+    for (uintptr_t p = start & ~(dline - 1); p < end; p += dline) {
+        __asm__ __volatile__("dc cvau, %0" : : "r"(p) : "memory");
+    }
+    __asm__ __volatile__("dsb ish" : : : "memory");
+    for (uintptr_t p = start & ~(iline - 1); p < end; p += iline) {
+        __asm__ __volatile__("ic ivau, %0" : : "r"(p) : "memory");
+    }
+    __asm__ __volatile__("dsb ish\n\tisb" : : : "memory");
+}
+
+// handoff.S: unmaps [start, start + len), then enters the program
+typedef void (*handoff_fn)(uintptr_t start, size_t len, uintptr_t entry,
+                           uintptr_t sp) __attribute__((noreturn));
+extern const char handoff_stub[], handoff_stub_end[];
+
+// Copy the hand-off stub into a page outside the loader image
+// That page (one per process) is all that is left of the loader
+static handoff_fn copy_handoff_stub(void) {
+    size_t len = handoff_stub_end - handoff_stub;
+    uint8_t *page = sys_mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) {
+        return NULL;
+    }
+    memcpy(page, handoff_stub, len);
+    sync_icache((uintptr_t)page, (uintptr_t)page + len);
+    if (sys_mprotect(page, PAGE_SIZE, PROT_READ | PROT_EXEC) < 0) {
+        sys_munmap(page, PAGE_SIZE);
+        return NULL;
+    }
+    return (handoff_fn)(uintptr_t)page;
+}
+
+void start_program(uintptr_t entry, int argc, char **argv, char **envp) {
+    uint64_t t = timing_stamp();
+    int envc = 0;
+    while (envp && envp[envc]) {
+        envc++;
+    }
+
+    void *stack = sys_mmap(NULL, PROGRAM_STACK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        mini_printf("Could not allocate program stack\n");
+        output_flush();
+        sys_exit(1);
+    }
+
+    // AT_RANDOM bytes go at the top of the stack, as the kernel puts them;
+    // the loader's own are reused (they seed nothing in the loader)
+    uint8_t *random = (uint8_t *)stack + PROGRAM_STACK_SIZE - 16;
+    const uint8_t *kernel_random = (const uint8_t *)auxv_get(AT_RANDOM);
+    if (kernel_random) {
+        memcpy(random, kernel_random, 16);
+    }
+
+    Elf64_auxv_t auxv[MAX_AUXV_ENTRIES];
+    size_t auxc = build_auxv(auxv, entry, argc > 0 ? argv[0] : "", random);
+
+    // argc, argv[], NULL, envp[], NULL, auxv pairs; sp stays 16-byte aligned
+    size_t words = 1 + (argc + 1) + (envc + 1) + 2 * auxc;
+    uintptr_t *sp = (uintptr_t *)random;
+    sp -= (words + 1) & ~1UL;
+
+    uintptr_t *p = sp;
+    *p++ = argc;
+    for (int i = 0; i < argc; i++) {
+        *p++ = (uintptr_t)argv[i];
+    }
+    *p++ = 0;
+    for (int i = 0; i < envc; i++) {
+        *p++ = (uintptr_t)envp[i];
+    }
+    *p++ = 0;
+    memcpy(p, auxv, auxc * sizeof(Elf64_auxv_t));
+    timing_add(PHASE_STACK, &t);
+
+    // Everything the program needs from the loader is on its stack now
+    handoff_fn handoff = NULL;
+    uintptr_t loader_start, loader_end;
+    if (handoff_reclaim && reclaim_loader_memory()) {
+        if (loader_extent(&loader_start, &loader_end) == 0) {
+            handoff = copy_handoff_stub();
+        }
+        if (handoff) {
+            mini_printf("Loader image: %lu bytes unmapped at the jump\n",
+                        loader_end - loader_start);
+        } else {
+            mini_printf("Loader image: kept, could not set up the hand-off\n");
+        }
+    }
+
+    output_flush();
+    timing_report();
+    syscall_stats_dump();
+
+    if (handoff) {
+        handoff(loader_start, loader_end - loader_start, entry, (uintptr_t)sp);
+    }
+
+    __asm__ __volatile__(
+        "mov sp, %0\n\t"
+        "mov x0, xzr\n\t"
+        "br %1"
+        : : "r"(sp), "r"(entry) : "x0", "memory");
+    __builtin_unreachable();
+}
+
+void load_elf_from_path(int argc, char **argv) {
+    uintptr_t entry = load_image(argv[0]);
+    if (!entry) {
+        return;
+    }
+
+    mini_printf("Jumping to entry point...\n\n");
+
+    handoff_reclaim = 1;
+    start_program(entry, argc, argv, loader_envp);
+}
+
+// Value of NAME in envp, or NULL if it is not set
+static const char *env_value(char **envp, const char *name) {
+    size_t len = strlen(name);
+    for (; envp && *envp; envp++) {
+        if (memcmp(*envp, name, len) == 0 && (*envp)[len] == '=') {
+            return *envp + len + 1;
+        }
+    }
+    return NULL;
+}
+
+// Whether NAME=<non-empty, not "0"> is set in envp
+static int env_flag(char **envp, const char *name) {
+    const char *value = env_value(envp, name);
+    return value && value[0] != '\0' && strcmp(value, "0") != 0;
+}
+
+int main(int argc, char **argv, char **envp) {
+    int argi = 1;
+    int server = 0;
+    int threads = 1;
+    int timing = env_flag(envp, "MINI_LOADER_TIMING");
+
+    loader_envp = envp;
+    dynlink_cfg.library_path = env_value(envp, "MINI_LOADER_LIBRARY_PATH");
+    dynlink_cfg.bind_now = env_flag(envp, "MINI_LOADER_BIND_NOW");
+    use_cache = env_flag(envp, "MINI_LOADER_CACHE");
+    drop_loader = env_flag(envp, "MINI_LOADER_DROP_LOADER");
+    verify_required = env_flag(envp, "MINI_LOADER_VERIFY");
+
+    for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] == '-'; argi++) {
+        if (strcmp(argv[argi], "--mmap") == 0) {
+            loader_mode = LOAD_MODE_MMAP;
+        } else if (strcmp(argv[argi], "--copy") == 0) {
+            loader_mode = LOAD_MODE_COPY;
+        } else if (strcmp(argv[argi], "--stream") == 0) {
+            loader_mode = LOAD_MODE_STREAM;
+        } else if (strcmp(argv[argi], "--fault-policy") == 0 && argi + 1 < argc) {
+            const char *policy = argv[++argi];
+            if (strcmp(policy, "lazy") == 0) {
+                fault_policy = FAULT_LAZY;
+            } else if (strcmp(policy, "prefault") == 0) {
+                fault_policy = FAULT_PREFAULT;
+            } else if (strcmp(policy, "text-only") == 0) {
+                fault_policy = FAULT_TEXT_ONLY;
+            } else {
+                mini_printf("Unknown fault policy: %s\n", policy);
+                return 1;
+            }
+        } else if (strcmp(argv[argi], "--huge") == 0) {
+            huge_pages = 1;
+        } else if (strcmp(argv[argi], "--cache") == 0) {
+            use_cache = 1;
+        } else if (strcmp(argv[argi], "--drop-loader") == 0) {
+            drop_loader = 1;
+        } else if (strcmp(argv[argi], "--verify") == 0) {
+            verify_required = 1;
+        } else if (strcmp(argv[argi], "--no-relocate") == 0) {
+            apply_relocations = 0;
+        } else if (strcmp(argv[argi], "--library-path") == 0 && argi + 1 < argc) {
+            dynlink_cfg.library_path = argv[++argi];
+        } else if (strcmp(argv[argi], "--bind-now") == 0) {
+            dynlink_cfg.bind_now = 1;
+        } else if (strcmp(argv[argi], "--trace-bind") == 0) {
+            dynlink_cfg.trace = 1;
+        } else if (strcmp(argv[argi], "--symbol") == 0 && argi + 1 < argc &&
+                   nlookup_names < MAX_LOOKUP_SYMBOLS) {
+            lookup_names[nlookup_names++] = argv[++argi];
+        } else if (strcmp(argv[argi], "--timing") == 0) {
+            timing = 1;
+        } else if (strcmp(argv[argi], "--server") == 0) {
+            server = 1;
+        } else if (strcmp(argv[argi], "--threads") == 0 && argi + 1 < argc) {
+            threads = parse_uint(argv[++argi]);
+        } else {
+            break;
+        }
+    }
+
+    if (argc - argi < 1 || (server && argc - argi != 1) || threads < 1) {
+        mini_printf("Usage: %s [--copy|--mmap|--stream] [--threads N] [--huge] [--cache]\n"
+                    "       [--fault-policy lazy|prefault|text-only] [--no-relocate]\n"
+                    "       [--library-path dirs] [--bind-now] [--trace-bind] [--drop-loader]\n"
+                    "       [--verify]\n"
+                    "       [--symbol name]... [--timing] [--server] <elf_file|-> [args...]\n", argv[0]);
+        return 1;
+    }
+
+    // "-" reads the image from stdin
+    if (strcmp(argv[argi], "-") == 0) {
+        if (server) {
+            mini_printf("--server cannot read the image from stdin\n");
+            return 1;
+        }
+        loader_mode = LOAD_MODE_STREAM;
+    }
+
+#ifdef LOADER_TIMING
+    timing_enabled = timing;
+#else
+    if (timing) {
+        mini_eprintf("mini_loader: timing not compiled in (rebuild with make TIMING=1)\n");
+    }
+#endif
+
+    thread_pool_init(threads);
+
+    if (server) {
+        return run_server(argv[argi], envp);
+    }
+
+    // The program sees its own path as argv[0], then everything after it
+    load_elf_from_path(argc - argi, argv + argi);
+
+    // Only reached if loading failed
+    return 1;
+}
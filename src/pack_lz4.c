@@ -0,0 +1,126 @@
+#include "arena.h"
+#include "elf_debug.h"
+#include "lz4.h"
+#include "lz4_image.h"
+#include "segment_crc.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Packer for the LZ4 container that mini_loader unpacks (lz4_image.h)
+//
+// Every PT_LOAD with file bytes becomes one LZ4 block; the ELF header and
+// program headers are kept raw. Section headers and anything else outside
+// the segments are not carried over.
+//
+// That includes a stamp_crc note. The loader fails a stamped image whose
+// note it cannot read, and moving the note would change the program
+// headers the checksums cover, so stamped images are refused; their
+// checksums have to come from a sidecar instead.
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+static struct arena scratch;
+
+static int write_all(int fd, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        long n = sys_write(fd, buf, len);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        mini_eprintf("Usage: %s <elf_file> <out>\n", argv[0]);
+        return 1;
+    }
+
+    struct elf_image img;
+    if (elf_image_open(&img, argv[1]) < 0) {
+        mini_eprintf("%s: not a valid ELF file\n", argv[1]);
+        return 1;
+    }
+    if (segment_crc_phdr(&img) >= 0) {
+        mini_eprintf("%s: has a stamp_crc note, which a container cannot carry\n"
+                     "Pack the unstamped image and use stamp_crc --sidecar instead\n",
+                     argv[1]);
+        return 1;
+    }
+
+    // ELF header and program headers, from the start of the file
+    uint64_t headers_size = img.ehdr->e_phoff + img.phnum * sizeof(Elf64_Phdr);
+    if (headers_size < sizeof(Elf64_Ehdr)) {
+        headers_size = sizeof(Elf64_Ehdr);
+    }
+
+    uint32_t nsegs = 0;
+    uint64_t bound = 0;
+    for (int i = 0; i < img.phnum; i++) {
+        if (img.phdrs[i].p_type == PT_LOAD && img.phdrs[i].p_filesz > 0) {
+            nsegs++;
+            bound += LZ4_COMPRESS_BOUND(img.phdrs[i].p_filesz);
+        }
+    }
+
+    uint64_t headers_offset = ALIGN_UP(sizeof(struct lz4_image_header) +
+                                       nsegs * sizeof(struct lz4_image_segment), 8);
+    uint64_t blocks_offset = headers_offset + headers_size;
+    uint8_t *out = arena_zalloc(&scratch, blocks_offset + bound, 16);
+    uint32_t *table = ARENA_ARRAY(&scratch, uint32_t, LZ4_HASH_SIZE);
+    if (!out || !table) {
+        mini_eprintf("Out of memory\n");
+        return 1;
+    }
+
+    struct lz4_image_header *h = (struct lz4_image_header *)out;
+    struct lz4_image_segment *segs = (struct lz4_image_segment *)(out + sizeof(*h));
+    memcpy(h->magic, LZ4_IMAGE_MAGIC, sizeof(h->magic));
+    h->version = LZ4_IMAGE_VERSION;
+    h->nsegs = nsegs;
+    h->elf_size = img.size;
+    h->headers_offset = headers_offset;
+    h->headers_size = headers_size;
+    memcpy(out + headers_offset, img.data, headers_size);
+
+    uint64_t pos = blocks_offset;
+    uint32_t n = 0;
+    for (int i = 0; i < img.phnum; i++) {
+        const Elf64_Phdr *p = &img.phdrs[i];
+        if (p->p_type != PT_LOAD || p->p_filesz == 0) {
+            continue;
+        }
+        size_t size = lz4_compress(img.data + p->p_offset, p->p_filesz,
+                                   out + pos, blocks_offset + bound - pos, table);
+        if (size == 0) {
+            mini_eprintf("Segment %d did not compress\n", i);
+            return 1;
+        }
+        segs[n].phdr = i;
+        segs[n].offset = pos;
+        segs[n].size = size;
+        segs[n].raw_size = p->p_filesz;
+        n++;
+        mini_printf("Segment %d: %lu -> %lu bytes\n", i, p->p_filesz, size);
+        pos += size;
+    }
+
+    int fd = sys_openat_mode(AT_FDCWD, argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        mini_eprintf("Could not create %s\n", argv[2]);
+        return 1;
+    }
+    if (write_all(fd, out, pos) < 0) {
+        mini_eprintf("Write to %s failed\n", argv[2]);
+        sys_close(fd);
+        return 1;
+    }
+    sys_close(fd);
+
+    mini_printf("%s: %lu -> %lu bytes\n", argv[2], img.size, pos);
+    elf_image_close(&img);
+    return 0;
+}
@@ -0,0 +1,20 @@
+// Shared library for plt_test: built with -shared as bin/libplt.so and
+// loaded by mini_loader as a DT_NEEDED dependency
+
+long plt_add(long a, long b) {
+    return a + b;
+}
+
+long plt_mul(long a, long b) {
+    return a * b;
+}
+
+// Uses every integer argument register
+long plt_sum8(long a, long b, long c, long d, long e, long f, long g, long h) {
+    return a + b + c + d + e + f + g + h;
+}
+
+// Uses the floating-point argument registers
+double plt_fma(double a, double b, double c) {
+    return a * b + c;
+}
@@ -0,0 +1,35 @@
+#include "syscalls.h"
+
+// Test image with a DT_NEEDED dependency (libplt.so), linked with
+// -z lazy so every call below goes through a lazily bound PLT slot.
+// The first call to each function enters mini_loader's resolver
+// trampoline; the second goes straight to the bound target. A wrong slot
+// index calls the wrong function and clobbered argument registers give a
+// wrong result, so either makes the exit status 1.
+//
+//   mini_loader --library-path bin bin/plt_test
+
+long plt_add(long a, long b);
+long plt_mul(long a, long b);
+long plt_sum8(long a, long b, long c, long d, long e, long f, long g, long h);
+double plt_fma(double a, double b, double c);
+
+static void say(const char *s) {
+    unsigned long len = 0;
+    while (s[len]) len++;
+    sys_write(1, s, len);
+}
+
+void _start(void) {
+    int failed = 0;
+
+    for (int i = 0; i < 2; i++) {
+        failed |= plt_mul(6, 7) != 42;
+        failed |= plt_add(40, 2) != 42;
+        failed |= plt_sum8(1, 2, 3, 4, 5, 6, 7, 8) != 36;
+        failed |= plt_fma(1.5, 4.0, 36.0) != 42.0;
+    }
+
+    say(failed ? "PLT calls: FAILED\n" : "PLT calls: ok\n");
+    sys_exit(failed);
+}
@@ -0,0 +1,249 @@
+#include "reloc.h"
+#include "syscalls.h"
+#include "utils.h"
+
+#define PAGE_SIZE page_size()
+#define PAGE_ALIGN_DOWN(x) ((x) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_UP(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+#ifndef DT_RELRSZ
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#define DT_RELRENT 37
+#endif
+
+// Where relocations may be written, and which read-only segments were
+// temporarily unlocked to do it
+struct reloc_ctx {
+    const Elf64_Phdr *phdrs;
+    int phnum;
+    uintptr_t load_bias;
+    int last_seg;               // segment of the previous target
+    uintptr_t last_page;
+    uint64_t unlocked[4];       // bitmap of PT_LOAD indices made writable
+    struct reloc_stats *stats;
+};
+
+static int segment_prot(const Elf64_Phdr *phdr) {
+    int prot = 0;
+    if (phdr->p_flags & PF_R) prot |= PROT_READ;
+    if (phdr->p_flags & PF_W) prot |= PROT_WRITE;
+    if (phdr->p_flags & PF_X) prot |= PROT_EXEC;
+    return prot;
+}
+
+// Find the PT_LOAD holding [addr, addr + 8), checking the previous one first
+// since relocation tables are sorted by address
+static int find_segment(struct reloc_ctx *ctx, uintptr_t addr) {
+    if (ctx->last_seg >= 0) {
+        const Elf64_Phdr *p = &ctx->phdrs[ctx->last_seg];
+        uintptr_t start = p->p_vaddr + ctx->load_bias;
+        if (addr >= start && addr - start + 8 <= p->p_memsz) {
+            return ctx->last_seg;
+        }
+    }
+    for (int i = 0; i < ctx->phnum; i++) {
+        const Elf64_Phdr *p = &ctx->phdrs[i];
+        uintptr_t start = p->p_vaddr + ctx->load_bias;
+        if (p->p_type == PT_LOAD && addr >= start && addr - start + 8 <= p->p_memsz) {
+            ctx->last_seg = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Store value at addr unless it is already there
+static int apply(struct reloc_ctx *ctx, uintptr_t addr, uint64_t value) {
+    int seg = find_segment(ctx, addr);
+    if (seg < 0 || (addr & 7)) {
+        return -1;
+    }
+
+    uint64_t *where = (uint64_t *)addr;
+    if (*where == value) {
+        ctx->stats->unchanged++;
+        return 0;
+    }
+
+    const Elf64_Phdr *p = &ctx->phdrs[seg];
+    if (!(p->p_flags & PF_W) && seg >= 256) {
+        return -1;
+    }
+    if (!(p->p_flags & PF_W) &&
+        !(ctx->unlocked[seg / 64] & (1ULL << (seg % 64)))) {
+        uintptr_t start = PAGE_ALIGN_DOWN(p->p_vaddr + ctx->load_bias);
+        uintptr_t end = PAGE_ALIGN_UP(p->p_vaddr + ctx->load_bias + p->p_memsz);
+        if (sys_mprotect((void *)start, end - start,
+                         segment_prot(p) | PROT_WRITE) < 0) {
+            return -1;
+        }
+        ctx->unlocked[seg / 64] |= 1ULL << (seg % 64);
+    }
+
+    *where = value;
+    if (PAGE_ALIGN_DOWN(addr) != ctx->last_page) {
+        ctx->last_page = PAGE_ALIGN_DOWN(addr);
+        ctx->stats->pages++;
+    }
+    return 0;
+}
+
+// Check that a table given by DT_* entries lies inside a mapped segment
+static int table_in_image(struct reloc_ctx *ctx, uintptr_t addr, uint64_t size) {
+    if (size == 0) {
+        return 1;
+    }
+    int seg = find_segment(ctx, addr);
+    if (seg < 0) {
+        return 0;
+    }
+    const Elf64_Phdr *p = &ctx->phdrs[seg];
+    return size <= p->p_memsz - (addr - (p->p_vaddr + ctx->load_bias));
+}
+
+static int apply_rela(struct reloc_ctx *ctx, const Elf64_Rela *rela, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t type = ELF64_R_TYPE(rela[i].r_info);
+        if (type == R_AARCH64_NONE) {
+            continue;
+        }
+        if (type == R_AARCH64_ABS64 || type == R_AARCH64_GLOB_DAT ||
+            type == R_AARCH64_JUMP_SLOT || type == R_AARCH64_COPY) {
+            // Need a symbol lookup; applied once every library is mapped
+            ctx->stats->symbolic++;
+            continue;
+        }
+        if (type != R_AARCH64_RELATIVE) {
+            ctx->stats->unsupported++;
+            continue;
+        }
+        if (apply(ctx, rela[i].r_offset + ctx->load_bias,
+                  rela[i].r_addend + ctx->load_bias) < 0) {
+            return -1;
+        }
+        ctx->stats->rela++;
+    }
+    return 0;
+}
+
+// DT_RELR: an even entry is an address to relocate, and starts a run; each
+// odd entry is a bitmap whose bits 1..63 say which of the next 63 words
+// after the current run position need relocating
+static int apply_relr(struct reloc_ctx *ctx, const uint64_t *relr, size_t count) {
+    uintptr_t base = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t entry = relr[i];
+
+        if ((entry & 1) == 0) {
+            uintptr_t addr = entry + ctx->load_bias;
+            if (find_segment(ctx, addr) < 0) {
+                return -1;
+            }
+            if (apply(ctx, addr, *(uint64_t *)addr + ctx->load_bias) < 0) {
+                return -1;
+            }
+            ctx->stats->relr++;
+            base = addr + 8;
+            continue;
+        }
+
+        if (base == 0) {
+            return -1;
+        }
+        uintptr_t addr = base;
+        for (entry >>= 1; entry != 0; entry >>= 1, addr += 8) {
+            if (!(entry & 1)) {
+                continue;
+            }
+            if (find_segment(ctx, addr) < 0) {
+                return -1;
+            }
+            if (apply(ctx, addr, *(uint64_t *)addr + ctx->load_bias) < 0) {
+                return -1;
+            }
+            ctx->stats->relr++;
+        }
+        base += 63 * 8;
+    }
+    return 0;
+}
+
+int relocate_image(const Elf64_Phdr *phdrs, int phnum, uintptr_t load_bias,
+                   struct reloc_stats *stats) {
+    uint64_t start_ns = monotonic_ns();
+    struct reloc_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.phdrs = phdrs;
+    ctx.phnum = phnum;
+    ctx.load_bias = load_bias;
+    ctx.last_seg = -1;
+    ctx.stats = stats;
+
+    const Elf64_Dyn *dyn = NULL;
+    size_t dyn_count = 0;
+    for (int i = 0; i < phnum; i++) {
+        if (phdrs[i].p_type == PT_DYNAMIC) {
+            dyn = (const Elf64_Dyn *)(phdrs[i].p_vaddr + load_bias);
+            dyn_count = phdrs[i].p_memsz / sizeof(Elf64_Dyn);
+            if (!table_in_image(&ctx, (uintptr_t)dyn, phdrs[i].p_memsz)) {
+                return -1;
+            }
+            break;
+        }
+    }
+    if (!dyn) {
+        // Nothing to do for images without a dynamic section
+        return 0;
+    }
+
+    uintptr_t rela = 0, relr = 0;
+    uint64_t relasz = 0, relaent = sizeof(Elf64_Rela);
+    uint64_t relrsz = 0, relrent = sizeof(uint64_t);
+
+    // The walk stays inside the segment: headers-only loads (containers,
+    // streams) have not seen the DT_NULL terminator before this point
+    size_t n = 0;
+    for (; n < dyn_count && dyn->d_tag != DT_NULL; n++, dyn++) {
+        switch (dyn->d_tag) {
+            case DT_RELA:     rela = dyn->d_un.d_ptr + load_bias; break;
+            case DT_RELASZ:   relasz = dyn->d_un.d_val; break;
+            case DT_RELAENT:  relaent = dyn->d_un.d_val; break;
+            case DT_RELR:     relr = dyn->d_un.d_ptr + load_bias; break;
+            case DT_RELRSZ:   relrsz = dyn->d_un.d_val; break;
+            case DT_RELRENT:  relrent = dyn->d_un.d_val; break;
+            default: break;
+        }
+    }
+    if (n == dyn_count) {
+        return -1;    // no DT_NULL terminator inside the segment
+    }
+
+    int result = 0;
+    if ((rela && relaent != sizeof(Elf64_Rela)) ||
+        (relr && relrent != sizeof(uint64_t)) ||
+        (rela && !table_in_image(&ctx, rela, relasz)) ||
+        (relr && !table_in_image(&ctx, relr, relrsz))) {
+        result = -1;
+    } else if (rela && apply_rela(&ctx, (const Elf64_Rela *)rela,
+                                  relasz / sizeof(Elf64_Rela)) < 0) {
+        result = -1;
+    } else if (relr && apply_relr(&ctx, (const uint64_t *)relr,
+                                  relrsz / sizeof(uint64_t)) < 0) {
+        result = -1;
+    }
+
+    // Put read-only segments back the way map_elf left them
+    for (int i = 0; i < phnum && i < 256; i++) {
+        if (ctx.unlocked[i / 64] & (1ULL << (i % 64))) {
+            const Elf64_Phdr *p = &phdrs[i];
+            uintptr_t start = PAGE_ALIGN_DOWN(p->p_vaddr + load_bias);
+            uintptr_t end = PAGE_ALIGN_UP(p->p_vaddr + load_bias + p->p_memsz);
+            sys_mprotect((void *)start, end - start, segment_prot(p));
+        }
+    }
+
+    stats->ns += monotonic_ns() - start_ns;
+    return result;
+}
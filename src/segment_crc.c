@@ -0,0 +1,110 @@
+#include "segment_crc.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Name and descriptor are each padded to 4 bytes
+#define NOTE_NAME_SIZE ((sizeof(SEGMENT_CRC_NAME) + 3) & ~3UL)
+
+struct crc_desc {
+    uint32_t version;
+    uint32_t count;
+    struct {
+        uint32_t phdr;
+        uint32_t crc;
+    } segs[];
+};
+
+// Sidecar files are never bigger than the largest note
+#define SIDECAR_MAX (sizeof(Elf64_Nhdr) + NOTE_NAME_SIZE + sizeof(struct crc_desc) + \
+                     SEGMENT_CRC_MAX * 8)
+
+size_t segment_crc_note_size(int count) {
+    return sizeof(Elf64_Nhdr) + NOTE_NAME_SIZE + sizeof(struct crc_desc) +
+           (size_t)count * 8;
+}
+
+void segment_crc_write_note(const struct segment_crc *sums, void *buf) {
+    uint8_t *p = buf;
+    memset(p, 0, segment_crc_note_size(sums->count));
+
+    Elf64_Nhdr *n = (Elf64_Nhdr *)p;
+    n->n_namesz = sizeof(SEGMENT_CRC_NAME);
+    n->n_descsz = sizeof(struct crc_desc) + sums->count * 8;
+    n->n_type = NT_SEGMENT_CRC;
+    memcpy(p + sizeof(*n), SEGMENT_CRC_NAME, sizeof(SEGMENT_CRC_NAME));
+
+    struct crc_desc *d = (struct crc_desc *)(p + sizeof(*n) + NOTE_NAME_SIZE);
+    d->version = SEGMENT_CRC_VERSION;
+    d->count = sums->count;
+    for (int i = 0; i < sums->count; i++) {
+        d->segs[i].phdr = sums->segs[i].phdr;
+        d->segs[i].crc = sums->segs[i].crc;
+    }
+}
+
+int segment_crc_parse(const void *data, size_t len, struct segment_crc *sums) {
+    const uint8_t *p = data;
+    if (len < sizeof(Elf64_Nhdr) + NOTE_NAME_SIZE + sizeof(struct crc_desc)) {
+        return -1;
+    }
+    const Elf64_Nhdr *n = (const Elf64_Nhdr *)p;
+    if (n->n_type != NT_SEGMENT_CRC || n->n_namesz != sizeof(SEGMENT_CRC_NAME) ||
+        memcmp(p + sizeof(*n), SEGMENT_CRC_NAME, sizeof(SEGMENT_CRC_NAME)) != 0) {
+        return -1;
+    }
+
+    const struct crc_desc *d = (const struct crc_desc *)(p + sizeof(*n) + NOTE_NAME_SIZE);
+    size_t room = len - sizeof(*n) - NOTE_NAME_SIZE;
+    if (d->version != SEGMENT_CRC_VERSION || d->count > SEGMENT_CRC_MAX ||
+        n->n_descsz != sizeof(*d) + d->count * 8 || n->n_descsz > room) {
+        return -1;
+    }
+
+    sums->count = (int)d->count;
+    for (uint32_t i = 0; i < d->count; i++) {
+        sums->segs[i].phdr = d->segs[i].phdr;
+        sums->segs[i].crc = d->segs[i].crc;
+    }
+    return 0;
+}
+
+int segment_crc_phdr(const struct elf_image *img) {
+    for (int i = 0; i < img->phnum; i++) {
+        const Elf64_Phdr *p = &img->phdrs[i];
+        if (p->p_type == PT_NOTE && p->p_memsz == 0 &&
+            p->p_filesz >= segment_crc_note_size(0) &&
+            (p->p_filesz - segment_crc_note_size(0)) % 8 == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int segment_crc_from_image(const struct elf_image *img, struct segment_crc *sums) {
+    int index = segment_crc_phdr(img);
+    if (index < 0) {
+        return -1;
+    }
+    const Elf64_Phdr *p = &img->phdrs[index];
+    const void *note = elf_image_at(img, p->p_offset, p->p_filesz);
+    return note ? segment_crc_parse(note, p->p_filesz, sums) : -1;
+}
+
+int segment_crc_from_sidecar(const char *path, struct segment_crc *sums) {
+    char name[4096];
+    size_t len = strlen(path);
+    if (len + sizeof(SEGMENT_CRC_SUFFIX) > sizeof(name)) {
+        return -1;
+    }
+    memcpy(name, path, len);
+    memcpy(name + len, SEGMENT_CRC_SUFFIX, sizeof(SEGMENT_CRC_SUFFIX));
+
+    int fd = sys_openat(AT_FDCWD, name, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    uint8_t buf[SIDECAR_MAX];
+    long n = sys_read(fd, buf, sizeof(buf));
+    sys_close(fd);
+    return n > 0 ? segment_crc_parse(buf, n, sums) : -1;
+}
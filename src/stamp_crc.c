@@ -0,0 +1,180 @@
+#include "arena.h"
+#include "crc32c.h"
+#include "elf_debug.h"
+#include "segment_crc.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Stamps per-segment CRC-32C checksums into an image for mini_loader to
+// verify (segment_crc.h)
+//
+// The note is appended to the file and a spare PT_NULL program header (or
+// the one a previous stamp used) is turned into an unloaded PT_NOTE for it.
+// Without a spare header, or with --sidecar, the note goes to <path>.crc
+// and the image is left untouched.
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+static struct arena scratch;
+
+static int write_at(int fd, uint64_t offset, const void *buf, size_t len) {
+    if (sys_lseek(fd, (long)offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    const uint8_t *p = buf;
+    while (len > 0) {
+        long n = sys_write(fd, p, len);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_sidecar(const char *path, const void *note, size_t len) {
+    char name[4096];
+    if (mini_snprintf(name, sizeof(name), "%s%s", path, SEGMENT_CRC_SUFFIX) >=
+        (int)sizeof(name) - 1) {
+        mini_eprintf("%s: path too long\n", path);
+        return -1;
+    }
+    int fd = sys_openat_mode(AT_FDCWD, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        mini_eprintf("Could not create %s\n", name);
+        return -1;
+    }
+    int ret = write_at(fd, 0, note, len);
+    sys_close(fd);
+    if (ret < 0) {
+        mini_eprintf("Write to %s failed\n", name);
+        return -1;
+    }
+    mini_printf("Wrote %s\n", name);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int sidecar = 0;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "--sidecar") == 0) {
+        sidecar = 1;
+        argi++;
+    }
+    if (argc - argi != 1) {
+        mini_eprintf("Usage: %s [--sidecar] <elf_file>\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[argi];
+
+    // The image is edited in a private copy, so the checksums cover the
+    // program headers as they will be on disk
+    int fd = sys_openat(AT_FDCWD, path, sidecar ? O_RDONLY : O_RDWR);
+    struct stat st;
+    if (fd < 0 || sys_fstat(fd, &st) < 0) {
+        mini_eprintf("Could not open %s\n", path);
+        return 1;
+    }
+    size_t size = st.st_size;
+    uint8_t *data = arena_alloc(&scratch, size ? size : 1, 16);
+    if (!data) {
+        mini_eprintf("Out of memory\n");
+        return 1;
+    }
+    for (size_t done = 0; done < size;) {
+        long n = sys_read(fd, data + done, size - done);
+        if (n <= 0) {
+            mini_eprintf("Read of %s failed\n", path);
+            return 1;
+        }
+        done += n;
+    }
+
+    struct elf_image img;
+    if (elf_image_from_memory(&img, data, size) < 0) {
+        mini_eprintf("%s: not a valid ELF file\n", path);
+        return 1;
+    }
+
+    struct segment_crc sums;
+    sums.count = 0;
+    for (int i = 0; i < img.phnum; i++) {
+        if (img.phdrs[i].p_type == PT_LOAD && img.phdrs[i].p_filesz > 0) {
+            if (sums.count == SEGMENT_CRC_MAX) {
+                mini_eprintf("%s: more than %d segments\n", path, SEGMENT_CRC_MAX);
+                return 1;
+            }
+            sums.segs[sums.count++].phdr = i;
+        }
+    }
+    size_t note_size = segment_crc_note_size(sums.count);
+
+    int slot = -1;
+    if (!sidecar) {
+        slot = segment_crc_phdr(&img);
+        for (int i = 0; i < img.phnum && slot < 0; i++) {
+            if (img.phdrs[i].p_type == PT_NULL) {
+                slot = i;
+            }
+        }
+        if (slot < 0) {
+            mini_printf("%s: no spare program header, using a sidecar file\n", path);
+            sidecar = 1;
+        }
+    }
+
+    // A note left by an earlier stamp at the end of the file is replaced
+    uint64_t note_offset = 0;
+    Elf64_Phdr *ph = NULL;
+    if (!sidecar) {
+        ph = (Elf64_Phdr *)(data + img.ehdr->e_phoff) + slot;
+        note_offset = ph->p_type == PT_NOTE && ph->p_offset + ph->p_filesz == size ?
+                      ph->p_offset : ALIGN_UP(size, 8);
+        memset(ph, 0, sizeof(*ph));
+        ph->p_type = PT_NOTE;
+        ph->p_flags = PF_R;
+        ph->p_offset = note_offset;
+        ph->p_filesz = note_size;
+        ph->p_align = 4;
+    }
+
+    uint64_t bytes = 0;
+    uint64_t t = monotonic_ns();
+    for (int i = 0; i < sums.count; i++) {
+        const Elf64_Phdr *p = &img.phdrs[sums.segs[i].phdr];
+        sums.segs[i].crc = crc32c(0, data + p->p_offset, p->p_filesz);
+        bytes += p->p_filesz;
+    }
+    t = monotonic_ns() - t;
+
+    uint8_t *note = arena_alloc(&scratch, note_size, 8);
+    if (!note) {
+        mini_eprintf("Out of memory\n");
+        return 1;
+    }
+    segment_crc_write_note(&sums, note);
+
+    for (int i = 0; i < sums.count; i++) {
+        mini_printf("Segment %d: %lu bytes, crc32c %08x\n", sums.segs[i].phdr,
+                    img.phdrs[sums.segs[i].phdr].p_filesz, sums.segs[i].crc);
+    }
+    mini_printf("Checksummed %lu bytes in %lu us (%s)\n", bytes, t / 1000,
+                crc32c_impl());
+
+    if (sidecar) {
+        sys_close(fd);
+        return write_sidecar(path, note, note_size) < 0 ? 1 : 0;
+    }
+
+    if (write_at(fd, img.ehdr->e_phoff + slot * sizeof(Elf64_Phdr), ph, sizeof(*ph)) < 0 ||
+        write_at(fd, note_offset, note, note_size) < 0 ||
+        sys_ftruncate(fd, note_offset + note_size) < 0) {
+        mini_eprintf("Write to %s failed\n", path);
+        sys_close(fd);
+        return 1;
+    }
+    sys_close(fd);
+    mini_printf("Stamped %s: program header %d, note at 0x%lx\n", path, slot, note_offset);
+    return 0;
+}
@@ -0,0 +1,382 @@
+#include "symbols.h"
+#include "syscalls.h"
+#include "utils.h"
+
+const void *loaded_image_at(const struct loaded_image *li, uint64_t vaddr,
+                            uint64_t len) {
+    for (int i = 0; i < li->phnum; i++) {
+        const Elf64_Phdr *p = &li->phdrs[i];
+        if (p->p_type != PT_LOAD || !(p->p_flags & PF_R) || vaddr < p->p_vaddr) {
+            continue;
+        }
+        uint64_t off = vaddr - p->p_vaddr;
+        if (off <= p->p_memsz && len <= p->p_memsz - off) {
+            return (const void *)(uintptr_t)(vaddr + li->load_bias);
+        }
+    }
+    return NULL;
+}
+
+// Number of symbols covered by a DT_GNU_HASH table: one past the end of
+// the chain that starts in the highest bucket
+// Returns 0 if the table runs outside the image
+static uint32_t gnu_hash_symbols(const struct loaded_image *li, uint64_t vaddr) {
+    const uint32_t *g = loaded_image_at(li, vaddr, 16);
+    if (!g || (vaddr & 7) || g[0] == 0 || g[2] == 0) {
+        return 0;
+    }
+    uint64_t nbuckets = g[0];
+    uint64_t symoffset = g[1];
+    uint64_t bloom_size = g[2];
+
+    uint64_t buckets_off = 16 + bloom_size * 8;
+    if (!loaded_image_at(li, vaddr, buckets_off + nbuckets * 4)) {
+        return 0;
+    }
+    const uint32_t *buckets = (const uint32_t *)((const uint8_t *)g + buckets_off);
+
+    uint32_t last = 0;
+    for (uint64_t i = 0; i < nbuckets; i++) {
+        if (buckets[i] > last) {
+            last = buckets[i];
+        }
+    }
+    if (last < symoffset) {
+        return symoffset;
+    }
+
+    // Chain entries run in parallel with the symbols from symoffset on;
+    // the low bit marks the last entry of a chain
+    uint64_t chain_vaddr = vaddr + buckets_off + nbuckets * 4;
+    for (;; last++) {
+        const uint32_t *entry = loaded_image_at(li, chain_vaddr + (uint64_t)(last - symoffset) * 4, 4);
+        if (!entry || last == UINT32_MAX) {
+            return 0;
+        }
+        if (*entry & 1) {
+            return last + 1;
+        }
+    }
+}
+
+void loaded_image_init(struct loaded_image *li, const struct elf_image *file,
+                       uintptr_t load_bias, struct arena *arena) {
+    memset(li, 0, sizeof(*li));
+    li->load_bias = load_bias;
+    li->file = *file;
+    li->phdrs = file->phdrs;
+    li->phnum = file->phnum;
+    li->arena = arena;
+
+    // .dynamic is not relocated, so its pointers are link-time addresses
+    uint64_t symtab = 0, strtab = 0, strsz = 0, hash = 0, gnu_hash = 0;
+    uint64_t syment = sizeof(Elf64_Sym);
+    for (size_t i = 0; i < file->dynnum; i++) {
+        const Elf64_Dyn *d = &file->dynamic[i];
+        switch (d->d_tag) {
+            case DT_SYMTAB:   symtab = d->d_un.d_ptr; break;
+            case DT_STRTAB:   strtab = d->d_un.d_ptr; break;
+            case DT_STRSZ:    strsz = d->d_un.d_val; break;
+            case DT_SYMENT:   syment = d->d_un.d_val; break;
+            case DT_HASH:     hash = d->d_un.d_ptr; break;
+            case DT_GNU_HASH: gnu_hash = d->d_un.d_ptr; break;
+        }
+    }
+    if (!symtab || !strtab || strsz == 0 || syment != sizeof(Elf64_Sym) ||
+        (symtab & 7) || (hash & 3)) {
+        return;
+    }
+
+    const char *dynstr = loaded_image_at(li, strtab, strsz);
+    if (!dynstr || dynstr[strsz - 1] != '\0') {
+        return;
+    }
+
+    uint32_t count = 0;
+    if (gnu_hash && (count = gnu_hash_symbols(li, gnu_hash)) > 0) {
+        li->gnu_hash = loaded_image_at(li, gnu_hash, 16);
+    } else if (hash) {
+        const uint32_t *h = loaded_image_at(li, hash, 8);
+        if (h && loaded_image_at(li, hash, (2 + (uint64_t)h[0] + h[1]) * 4)) {
+            li->sysv_hash = h;
+            count = h[1];
+        }
+    }
+    if (!li->gnu_hash && !li->sysv_hash) {
+        return;
+    }
+
+    li->dynsym = loaded_image_at(li, symtab, (uint64_t)count * sizeof(Elf64_Sym));
+    if (!li->dynsym) {
+        li->gnu_hash = NULL;
+        li->sysv_hash = NULL;
+        return;
+    }
+    li->dynstr = dynstr;
+    li->dynstr_size = strsz;
+    li->dynsym_count = count;
+}
+
+void loaded_image_close(struct loaded_image *li) {
+    elf_image_close(&li->file);
+    li->dynsym = NULL;
+    li->gnu_hash = NULL;
+    li->sysv_hash = NULL;
+    li->symtab_state = -1;
+}
+
+static uint32_t gnu_hash_name(const char *name) {
+    uint32_t h = 5381;
+    for (const unsigned char *s = (const unsigned char *)name; *s; s++) {
+        h = h * 33 + *s;
+    }
+    return h;
+}
+
+static uint32_t sysv_hash_name(const char *name) {
+    uint32_t h = 0;
+    for (const unsigned char *s = (const unsigned char *)name; *s; s++) {
+        h = (h << 4) + *s;
+        uint32_t g = h & 0xf0000000;
+        if (g) {
+            h ^= g >> 24;
+        }
+        h &= ~g;
+    }
+    return h;
+}
+
+uintptr_t loader_symbol_address(const struct loaded_image *li, const Elf64_Sym *sym) {
+    if (sym->st_shndx == SHN_ABS) {
+        return sym->st_value;
+    }
+    return sym->st_value + li->load_bias;
+}
+
+// A defined, exported dynamic symbol called name
+static int dynsym_matches(const struct loaded_image *li, uint32_t index,
+                          const char *name) {
+    const Elf64_Sym *sym = &li->dynsym[index];
+    return sym->st_shndx != SHN_UNDEF &&
+           ELF64_ST_BIND(sym->st_info) != STB_LOCAL &&
+           ELF64_ST_TYPE(sym->st_info) != STT_TLS &&
+           sym->st_name < li->dynstr_size &&
+           strcmp(li->dynstr + sym->st_name, name) == 0;
+}
+
+// Bloom filter first: two bits per symbol, so most misses never touch a
+// bucket. Chains are sorted runs of hashes whose low bit ends the run.
+static const Elf64_Sym *gnu_lookup(const struct loaded_image *li, const char *name) {
+    const uint32_t *g = li->gnu_hash;
+    uint32_t nbuckets = g[0];
+    uint32_t symoffset = g[1];
+    uint32_t bloom_size = g[2];
+    uint32_t shift = g[3];
+    const uint64_t *bloom = (const uint64_t *)(g + 4);
+    const uint32_t *buckets = (const uint32_t *)(bloom + bloom_size);
+    const uint32_t *chain = buckets + nbuckets;
+
+    uint32_t h = gnu_hash_name(name);
+    uint64_t word = bloom[(h / 64) % bloom_size];
+    uint64_t mask = (1UL << (h % 64)) | (1UL << ((h >> shift) % 64));
+    if ((word & mask) != mask) {
+        return NULL;
+    }
+
+    uint32_t i = buckets[h % nbuckets];
+    if (i < symoffset) {
+        return NULL;
+    }
+    for (; i < li->dynsym_count; i++) {
+        uint32_t h2 = chain[i - symoffset];
+        if ((h | 1) == (h2 | 1) && dynsym_matches(li, i, name)) {
+            return &li->dynsym[i];
+        }
+        if (h2 & 1) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static const Elf64_Sym *sysv_lookup(const struct loaded_image *li, const char *name) {
+    const uint32_t *h = li->sysv_hash;
+    uint32_t nbucket = h[0];
+    uint32_t nchain = h[1];
+    const uint32_t *bucket = h + 2;
+    const uint32_t *chain = bucket + nbucket;
+    if (nbucket == 0) {
+        return NULL;
+    }
+
+    // A chain can visit every symbol at most once; anything longer is a loop
+    uint32_t i = bucket[sysv_hash_name(name) % nbucket];
+    for (uint32_t steps = 0; i != STN_UNDEF && i < nchain && steps < nchain; steps++) {
+        if (dynsym_matches(li, i, name)) {
+            return &li->dynsym[i];
+        }
+        i = chain[i];
+    }
+    return NULL;
+}
+
+// Binding order for duplicate names in .symtab: global, weak, then local
+static int binding_rank(const Elf64_Sym *sym) {
+    switch (ELF64_ST_BIND(sym->st_info)) {
+        case STB_GLOBAL: return 0;
+        case STB_WEAK:   return 1;
+        default:         return 2;
+    }
+}
+
+static int symtab_compare(const struct loaded_image *li, uint32_t a, uint32_t b) {
+    const Elf64_Sym *sa = &li->symtab[a];
+    const Elf64_Sym *sb = &li->symtab[b];
+    int c = strcmp(li->strtab + sa->st_name, li->strtab + sb->st_name);
+    if (c == 0) {
+        c = binding_rank(sa) - binding_rank(sb);
+    }
+    if (c == 0) {
+        c = (a > b) - (a < b);
+    }
+    return c;
+}
+
+static void sift_down(const struct loaded_image *li, uint32_t *v, size_t root,
+                      size_t n) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= n) {
+            return;
+        }
+        if (child + 1 < n && symtab_compare(li, v[child], v[child + 1]) < 0) {
+            child++;
+        }
+        if (symtab_compare(li, v[root], v[child]) >= 0) {
+            return;
+        }
+        uint32_t tmp = v[root];
+        v[root] = v[child];
+        v[child] = tmp;
+        root = child;
+    }
+}
+
+// Heap sort: in place and O(n log n) for symbol tables of any size
+static void sort_symtab(const struct loaded_image *li, uint32_t *v, size_t n) {
+    for (size_t i = n / 2; i-- > 0;) {
+        sift_down(li, v, i, n);
+    }
+    for (size_t end = n; end-- > 1;) {
+        uint32_t tmp = v[0];
+        v[0] = v[end];
+        v[end] = tmp;
+        sift_down(li, v, 0, end);
+    }
+}
+
+// Build the sorted .symtab index from the file's section headers
+static int build_symtab_index(struct loaded_image *li) {
+    const struct elf_image *file = &li->file;
+    const Elf64_Shdr *symsec = NULL;
+    for (int i = 0; i < file->shnum; i++) {
+        if (file->shdrs[i].sh_type == SHT_SYMTAB) {
+            symsec = &file->shdrs[i];
+            break;
+        }
+    }
+    if (!symsec || symsec->sh_entsize != sizeof(Elf64_Sym) ||
+        symsec->sh_link >= (uint32_t)file->shnum) {
+        return -1;
+    }
+
+    const Elf64_Shdr *strsec = &file->shdrs[symsec->sh_link];
+    size_t nsyms = symsec->sh_size / sizeof(Elf64_Sym);
+    const Elf64_Sym *syms = elf_image_at(file, symsec->sh_offset,
+                                         nsyms * sizeof(Elf64_Sym));
+    const char *strs = elf_image_at(file, strsec->sh_offset, strsec->sh_size);
+    if (!syms || !strs || strsec->sh_size == 0 ||
+        strs[strsec->sh_size - 1] != '\0' || nsyms > UINT32_MAX) {
+        return -1;
+    }
+
+    uint32_t *sorted = ARENA_ARRAY(li->arena, uint32_t, nsyms);
+    if (!sorted) {
+        return -1;
+    }
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nsyms; i++) {
+        const Elf64_Sym *sym = &syms[i];
+        int type = ELF64_ST_TYPE(sym->st_info);
+        if (sym->st_shndx == SHN_UNDEF || sym->st_name == 0 ||
+            sym->st_name >= strsec->sh_size || type == STT_SECTION ||
+            type == STT_FILE || type == STT_TLS) {
+            continue;
+        }
+        sorted[n++] = i;
+    }
+
+    li->symtab = syms;
+    li->strtab = strs;
+    sort_symtab(li, sorted, n);
+    li->sorted = sorted;
+    li->sorted_count = n;
+    return 0;
+}
+
+// Lower-bound binary search; the first match is the best-ranked binding
+static const Elf64_Sym *symtab_lookup(struct loaded_image *li, const char *name) {
+    if (li->symtab_state == 0) {
+        li->symtab_state = build_symtab_index(li) == 0 ? 1 : -1;
+    }
+    if (li->symtab_state < 0) {
+        return NULL;
+    }
+
+    uint32_t lo = 0, hi = li->sorted_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const Elf64_Sym *sym = &li->symtab[li->sorted[mid]];
+        if (strcmp(li->strtab + sym->st_name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == li->sorted_count) {
+        return NULL;
+    }
+    const Elf64_Sym *sym = &li->symtab[li->sorted[lo]];
+    return strcmp(li->strtab + sym->st_name, name) == 0 ? sym : NULL;
+}
+
+const Elf64_Sym *loader_find_dynsym(const struct loaded_image *li, const char *name) {
+    if (li->gnu_hash) {
+        return gnu_lookup(li, name);
+    }
+    if (li->sysv_hash) {
+        return sysv_lookup(li, name);
+    }
+    return NULL;
+}
+
+uintptr_t loader_lookup_symbol(struct loaded_image *li, const char *name) {
+    const Elf64_Sym *sym = loader_find_dynsym(li, name);
+    if (!sym) {
+        sym = symtab_lookup(li, name);
+    }
+    return sym ? loader_symbol_address(li, sym) : 0;
+}
+
+size_t loader_lookup_symbols(struct loaded_image *li, const char *const *names,
+                             size_t count, uintptr_t *addrs) {
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        addrs[i] = loader_lookup_symbol(li, names[i]);
+        if (addrs[i]) {
+            found++;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,130 @@
+#include "syscalls.h"
+#include "utils.h"
+
+// Per-syscall counters behind the hooks in syscalls.h; only built with
+// make STATS=1
+//
+// Worker threads make syscalls too, so the counters are updated atomically.
+// The table is printed to stderr when main returns (start.S), on
+// sys_exit() and, in mini_loader, just before the jump into the program.
+
+#define MAX_SYSCALL 512
+
+struct syscall_counter {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t ticks;
+};
+
+static struct syscall_counter counters[MAX_SYSCALL];
+
+static const char *syscall_name(long n) {
+    switch (n) {
+        case SYS_read:              return "read";
+        case SYS_write:             return "write";
+        case SYS_writev:            return "writev";
+        case SYS_openat:            return "openat";
+        case SYS_close:             return "close";
+        case SYS_lseek:             return "lseek";
+        case SYS_ftruncate:         return "ftruncate";
+        case SYS_mmap:              return "mmap";
+        case SYS_munmap:            return "munmap";
+        case SYS_mprotect:          return "mprotect";
+        case SYS_madvise:           return "madvise";
+        case SYS_getrusage:         return "getrusage";
+        case SYS_brk:               return "brk";
+        case SYS_exit:              return "exit";
+        case SYS_clock_gettime:     return "clock_gettime";
+        case SYS_dup3:              return "dup3";
+        case SYS_clone:             return "clone";
+        case SYS_wait4:             return "wait4";
+        case SYS_execve:            return "execve";
+        case SYS_futex:             return "futex";
+        case SYS_getpid:            return "getpid";
+        case SYS_process_vm_readv:  return "process_vm_readv";
+        case SYS_newfstatat:        return "newfstatat";
+        case SYS_fstat:             return "fstat";
+        case SYS_getuid:            return "getuid";
+        case SYS_renameat2:         return "renameat2";
+        case SYS_unlinkat:          return "unlinkat";
+        case SYS_io_uring_setup:    return "io_uring_setup";
+        case SYS_io_uring_enter:    return "io_uring_enter";
+        default:                    return NULL;
+    }
+}
+
+void syscall_account(long n, long ret, long len, uint64_t start) {
+    uint64_t ticks = syscall_ticks() - start;
+    if ((unsigned long)n >= MAX_SYSCALL) {
+        return;
+    }
+
+    // Reads and writes count what they moved, mapping calls the length
+    // they covered; failed calls count no bytes
+    uint64_t bytes = 0;
+    if (ret >= 0 || ret < -4095) {
+        switch (n) {
+            case SYS_read:
+            case SYS_write:
+            case SYS_writev:
+            case SYS_process_vm_readv:
+                bytes = ret;
+                break;
+            case SYS_mmap:
+            case SYS_munmap:
+            case SYS_mprotect:
+            case SYS_madvise:
+                bytes = len;
+                break;
+        }
+    }
+
+    struct syscall_counter *c = &counters[n];
+    __atomic_fetch_add(&c->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->ticks, ticks, __ATOMIC_RELAXED);
+}
+
+// One line per syscall that was made, then the totals:
+// "syscall_stats[pid] name calls bytes ns"
+void syscall_stats_dump(void) {
+    // Printing makes syscalls of its own: report the table as it was
+    static struct syscall_counter snap[MAX_SYSCALL];
+    for (int i = 0; i < MAX_SYSCALL; i++) {
+        snap[i].calls = __atomic_load_n(&counters[i].calls, __ATOMIC_RELAXED);
+        snap[i].bytes = __atomic_load_n(&counters[i].bytes, __ATOMIC_RELAXED);
+        snap[i].ticks = __atomic_load_n(&counters[i].ticks, __ATOMIC_RELAXED);
+    }
+
+    uint64_t freq;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+    if (freq == 0) {
+        freq = 1;
+    }
+
+    long pid = sys_getpid();
+    uint64_t calls = 0;
+    uint64_t ns_total = 0;
+    mini_eprintf("syscall_stats[%ld] %-18s %10s %14s %12s\n",
+                 pid, "syscall", "calls", "bytes", "ns");
+    for (int i = 0; i < MAX_SYSCALL; i++) {
+        const struct syscall_counter *c = &snap[i];
+        if (c->calls == 0) {
+            continue;
+        }
+        uint64_t ns = c->ticks / freq * 1000000000UL +
+                      c->ticks % freq * 1000000000UL / freq;
+        char number[24];
+        const char *name = syscall_name(i);
+        if (!name) {
+            mini_snprintf(number, sizeof(number), "syscall_%d", i);
+            name = number;
+        }
+        mini_eprintf("syscall_stats[%ld] %-18s %10lu %14lu %12lu\n",
+                     pid, name, c->calls, c->bytes, ns);
+        calls += c->calls;
+        ns_total += ns;
+    }
+    mini_eprintf("syscall_stats[%ld] %-18s %10lu %14s %12lu\n",
+                 pid, "total", calls, "", ns_total);
+}
@@ -0,0 +1,176 @@
+#include "threads.h"
+#include "syscalls.h"
+#include "utils.h"
+
+#define THREAD_STACK_SIZE (64UL << 10)
+
+#define THREAD_CLONE_FLAGS (CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | \
+                            CLONE_THREAD | CLONE_SYSVSEM | \
+                            CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID)
+
+// long thread_clone(unsigned long flags, void *stack_top, uint32_t *tid,
+//                   int (*fn)(void *), void *arg)
+//
+// fn and arg are pushed onto the new stack before the syscall because the
+// child comes back from clone with nothing but its stack pointer. The kernel
+// stores the new thread id in *tid, then clears it and wakes futex waiters
+// on *tid when the thread exits, which is what thread_pool_shutdown() joins on.
+__asm__(
+    "    .text\n"
+    "    .align 2\n"
+    "    .type thread_clone, %function\n"
+    "thread_clone:\n"
+    "    stp x3, x4, [x1, #-16]!\n"
+    "    mov x4, x2\n"                  // child_tid
+    "    mov x3, xzr\n"                 // tls
+    "    mov x8, #220\n"                // __NR_clone (parent_tid stays in x2)
+    "    svc #0\n"
+    "    cbz x0, 1f\n"
+    "    ret\n"
+    "1:  ldp x1, x0, [sp], #16\n"       // x1 = fn, x0 = arg
+    "    blr x1\n"
+    "    mov x8, #93\n"                 // __NR_exit: ends this thread only
+    "    svc #0\n"
+    "    .size thread_clone, .-thread_clone\n"
+);
+
+long thread_clone(unsigned long flags, void *stack_top, uint32_t *tid,
+                  int (*fn)(void *), void *arg);
+
+struct worker {
+    uint32_t tid;   // cleared by the kernel when the thread exits
+    void *stack;
+};
+
+static struct {
+    int nworkers;
+    uint32_t generation;    // futex: bumped for every job and for shutdown
+    uint32_t pending;       // futex: workers still busy with the current job
+    int shutdown;
+
+    void (*fn)(void *, size_t);
+    void *arg;
+    size_t count;
+    size_t next;            // next index to claim
+
+    struct worker workers[THREAD_POOL_MAX];
+} pool;
+
+static void futex_wait(uint32_t *addr, uint32_t val) {
+    sys_futex(addr, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, val);
+}
+
+static void futex_wake(uint32_t *addr, uint32_t count) {
+    sys_futex(addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count);
+}
+
+// Claim and run indices until the current job is exhausted
+static void run_job(void) {
+    size_t count = pool.count;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&pool.next, 1, __ATOMIC_RELAXED);
+        if (i >= count) {
+            break;
+        }
+        pool.fn(pool.arg, i);
+    }
+}
+
+static int worker_main(void *unused) {
+    (void)unused;
+    uint32_t seen = 0;
+
+    for (;;) {
+        uint32_t gen;
+        while ((gen = __atomic_load_n(&pool.generation, __ATOMIC_ACQUIRE)) == seen) {
+            futex_wait(&pool.generation, seen);
+        }
+        seen = gen;
+
+        if (__atomic_load_n(&pool.shutdown, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+
+        run_job();
+
+        if (__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_RELEASE) == 0) {
+            futex_wake(&pool.pending, 1);
+        }
+    }
+}
+
+int thread_pool_init(int nthreads) {
+    if (nthreads > THREAD_POOL_MAX) {
+        nthreads = THREAD_POOL_MAX;
+    }
+
+    for (int i = pool.nworkers; i < nthreads - 1; i++) {
+        struct worker *w = &pool.workers[i];
+
+        w->stack = sys_mmap(NULL, THREAD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (w->stack == MAP_FAILED) {
+            break;
+        }
+
+        long tid = thread_clone(THREAD_CLONE_FLAGS,
+                                (uint8_t *)w->stack + THREAD_STACK_SIZE,
+                                &w->tid, worker_main, NULL);
+        if (tid < 0) {
+            sys_munmap(w->stack, THREAD_STACK_SIZE);
+            break;
+        }
+        pool.nworkers++;
+    }
+
+    return pool.nworkers + 1;
+}
+
+int thread_pool_size(void) {
+    return pool.nworkers + 1;
+}
+
+void thread_pool_run(void (*fn)(void *arg, size_t index), void *arg, size_t count) {
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.count = count;
+    pool.next = 0;
+
+    if (pool.nworkers == 0 || count <= 1) {
+        run_job();
+        return;
+    }
+
+    __atomic_store_n(&pool.pending, pool.nworkers, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool.generation, 1, __ATOMIC_RELEASE);
+    futex_wake(&pool.generation, pool.nworkers);
+
+    run_job();
+
+    uint32_t pending;
+    while ((pending = __atomic_load_n(&pool.pending, __ATOMIC_ACQUIRE)) != 0) {
+        futex_wait(&pool.pending, pending);
+    }
+}
+
+void thread_pool_shutdown(void) {
+    if (pool.nworkers == 0) {
+        return;
+    }
+
+    __atomic_store_n(&pool.shutdown, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&pool.generation, 1, __ATOMIC_RELEASE);
+    futex_wake(&pool.generation, pool.nworkers);
+
+    for (int i = 0; i < pool.nworkers; i++) {
+        struct worker *w = &pool.workers[i];
+        uint32_t tid;
+        while ((tid = __atomic_load_n(&w->tid, __ATOMIC_ACQUIRE)) != 0) {
+            futex_wait(&w->tid, tid);
+        }
+        sys_munmap(w->stack, THREAD_STACK_SIZE);
+    }
+
+    pool.nworkers = 0;
+    pool.shutdown = 0;
+}
@@ -0,0 +1,208 @@
+#include "tool_stream.h"
+#include "syscalls.h"
+#include "utils.h"
+
+// Paths read from stdin are at most this long (PATH_MAX)
+#define PATH_BUF_SIZE 4096
+#define STDIN_BUF_SIZE (64UL << 10)
+
+int tool_parse_args(int argc, char **argv, struct tool_options *opts) {
+    opts->format = OUTPUT_HUMAN;
+    opts->from_stdin = 0;
+
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (strcmp(argv[argi], "--json") == 0) {
+            opts->format = OUTPUT_JSON;
+        } else if (strcmp(argv[argi], "--tsv") == 0) {
+            opts->format = OUTPUT_TSV;
+        } else if (strcmp(argv[argi], "-0") == 0) {
+            opts->from_stdin = 1;
+        } else {
+            break;
+        }
+    }
+    opts->first_path = argi;
+    opts->many = opts->from_stdin || argc - argi > 1;
+
+    if (opts->from_stdin == (argi < argc)) {
+        mini_printf("Usage: %s [--json|--tsv] <elf_file>...\n", argv[0]);
+        mini_printf("       %s [--json|--tsv] -0 < nul-separated-paths\n", argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int tool_for_each_path(int argc, char **argv, const struct tool_options *opts,
+                       int (*fn)(const char *path, void *arg), void *arg) {
+    int failures = 0;
+
+    if (!opts->from_stdin) {
+        for (int i = opts->first_path; i < argc; i++) {
+            if (fn(argv[i], arg) < 0) {
+                failures++;
+            }
+        }
+        return failures;
+    }
+
+    // Paths are split on NUL; a partial path at the end of the buffer is
+    // moved to the front before the next read. A path that outgrows
+    // PATH_BUF_SIZE is dropped along with the rest of it, up to its NUL.
+    static char buf[STDIN_BUF_SIZE + 1];
+    size_t len = 0;
+    int skipping = 0;
+    for (;;) {
+        long n = sys_read(0, buf + len, STDIN_BUF_SIZE - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+
+        size_t start = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (buf[i] != '\0') {
+                continue;
+            }
+            if (skipping) {
+                skipping = 0;
+            } else if (i - start >= PATH_BUF_SIZE) {
+                mini_eprintf("%s: path on stdin too long, skipped\n", argv[0]);
+                failures++;
+            } else if (i > start && fn(buf + start, arg) < 0) {
+                failures++;
+            }
+            start = i + 1;
+        }
+        if (skipping) {
+            start = len;
+        }
+        memmove(buf, buf + start, len - start);
+        len -= start;
+
+        if (len >= PATH_BUF_SIZE) {
+            mini_eprintf("%s: path on stdin too long, skipped\n", argv[0]);
+            failures++;
+            skipping = 1;
+            len = 0;
+        }
+    }
+
+    // The list does not have to end with a NUL
+    if (len > 0 && !skipping) {
+        buf[len] = '\0';
+        if (fn(buf, arg) < 0) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+void record_reset(struct record *r) {
+    r->len = 0;
+    r->overflow = 0;
+}
+
+void record_printf(struct record *r, const char *fmt, ...) {
+    size_t room = RECORD_MAX - r->len;
+    va_list args;
+    va_start(args, fmt);
+    int n = mini_vsnprintf(r->buf + r->len, room, fmt, args);
+    va_end(args);
+
+    // mini_vsnprintf keeps one byte for the NUL; filling the rest means
+    // the output was cut
+    if ((size_t)n + 1 >= room) {
+        r->overflow = 1;
+    }
+    r->len += n;
+}
+
+static void record_putc(struct record *r, char c) {
+    if (r->len + 1 >= RECORD_MAX) {
+        r->overflow = 1;
+        return;
+    }
+    r->buf[r->len++] = c;
+}
+
+void record_json_string(struct record *r, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+
+    record_putc(r, '"');
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            record_putc(r, '\\');
+            record_putc(r, c);
+        } else if (c == '\n') {
+            record_putc(r, '\\');
+            record_putc(r, 'n');
+        } else if (c == '\t') {
+            record_putc(r, '\\');
+            record_putc(r, 't');
+        } else if (c < 0x20) {
+            record_printf(r, "\\u00");
+            record_putc(r, hex[c >> 4]);
+            record_putc(r, hex[c & 0xf]);
+        } else {
+            // Bytes >= 0x80 are passed through; file names are not
+            // guaranteed to be UTF-8 and consumers get them unchanged
+            record_putc(r, c);
+        }
+    }
+    record_putc(r, '"');
+}
+
+void record_tsv_field(struct record *r, const char *s) {
+    for (; *s; s++) {
+        if (*s == '\t') {
+            record_putc(r, '\\');
+            record_putc(r, 't');
+        } else if (*s == '\n') {
+            record_putc(r, '\\');
+            record_putc(r, 'n');
+        } else if (*s == '\\') {
+            record_putc(r, '\\');
+            record_putc(r, '\\');
+        } else {
+            record_putc(r, *s);
+        }
+    }
+}
+
+int record_emit(struct record *r) {
+    if (r->overflow) {
+        record_reset(r);
+        return -1;
+    }
+
+    // Anything mini_printf buffered goes first, so the order is preserved
+    output_flush();
+
+    size_t done = 0;
+    while (done < r->len) {
+        long n = sys_write(1, r->buf + done, r->len - done);
+        if (n <= 0) {
+            record_reset(r);
+            return -1;
+        }
+        done += n;
+    }
+    record_reset(r);
+    return 0;
+}
+
+void record_error(struct record *r, int format, const char *path, const char *msg) {
+    if (format != OUTPUT_JSON) {
+        mini_eprintf("%s: %s\n", path, msg);
+        return;
+    }
+    record_reset(r);
+    record_printf(r, "{\"path\":");
+    record_json_string(r, path);
+    record_printf(r, ",\"error\":");
+    record_json_string(r, msg);
+    record_printf(r, "}\n");
+    record_emit(r);
+}
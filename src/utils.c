@@ -1,26 +1,284 @@
 #include "utils.h"
+#include "elf_format.h"
 #include "syscalls.h"
 #include <stdarg.h>
 
-// Memory copy - byte by byte
+// Unaligned-safe word types for the bulk loops below
+typedef uint64_t __attribute__((__may_alias__, __aligned__(1))) u64_ua;
+typedef uint32_t __attribute__((__may_alias__, __aligned__(1))) u32_ua;
+
+// Copy 16 bytes (one q register on AArch64, two words elsewhere)
+static inline void copy16(unsigned char *d, const unsigned char *s) {
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    __asm__ __volatile__(
+        "ldr q0, [%1]\n\t"
+        "str q0, [%0]"
+        : : "r"(d), "r"(s) : "v0", "memory");
+#else
+    uint64_t a = *(const u64_ua *)s;
+    uint64_t b = *(const u64_ua *)(s + 8);
+    *(u64_ua *)d = a;
+    *(u64_ua *)(d + 8) = b;
+#endif
+}
+
+// Copy 64 bytes; all loads complete before any store
+static inline void copy64(unsigned char *d, const unsigned char *s) {
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    __asm__ __volatile__(
+        "ldp q0, q1, [%1]\n\t"
+        "ldp q2, q3, [%1, #32]\n\t"
+        "stp q0, q1, [%0]\n\t"
+        "stp q2, q3, [%0, #32]"
+        : : "r"(d), "r"(s) : "v0", "v1", "v2", "v3", "memory");
+#else
+    uint64_t w[8];
+    for (int i = 0; i < 8; i++) {
+        w[i] = *(const u64_ua *)(s + 8 * i);
+    }
+    for (int i = 0; i < 8; i++) {
+        *(u64_ua *)(d + 8 * i) = w[i];
+    }
+#endif
+}
+
+// Fill 64 bytes with the 8-byte pattern
+static inline void fill64(unsigned char *d, uint64_t pattern) {
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    __asm__ __volatile__(
+        "dup v0.2d, %1\n\t"
+        "stp q0, q0, [%0]\n\t"
+        "stp q0, q0, [%0, #32]"
+        : : "r"(d), "r"(pattern) : "v0", "memory");
+#else
+    for (int i = 0; i < 8; i++) {
+        *(u64_ua *)(d + 8 * i) = pattern;
+    }
+#endif
+}
+
+// Memory copy - 16/64-byte blocks with overlapping head and tail stores
+// Small sizes use two possibly-overlapping accesses instead of a byte loop
 void *memcpy(void *dest, const void *src, size_t n) {
     unsigned char *d = (unsigned char *)dest;
     const unsigned char *s = (const unsigned char *)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
+
+    if (n < 16) {
+        if (n >= 8) {
+            uint64_t a = *(const u64_ua *)s;
+            uint64_t b = *(const u64_ua *)(s + n - 8);
+            *(u64_ua *)d = a;
+            *(u64_ua *)(d + n - 8) = b;
+        } else if (n >= 4) {
+            uint32_t a = *(const u32_ua *)s;
+            uint32_t b = *(const u32_ua *)(s + n - 4);
+            *(u32_ua *)d = a;
+            *(u32_ua *)(d + n - 4) = b;
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                d[i] = s[i];
+            }
+        }
+        return dest;
+    }
+
+    if (n <= 32) {
+        copy16(d, s);
+        copy16(d + n - 16, s + n - 16);
+        return dest;
+    }
+
+    // Copy the unaligned head, then continue from a 16-byte aligned dest
+    copy16(d, s);
+    size_t skew = 16 - ((uintptr_t)d & 15);
+    d += skew;
+    s += skew;
+    n -= skew;
+
+    while (n > 64) {
+        copy64(d, s);
+        d += 64;
+        s += 64;
+        n -= 64;
+    }
+
+    // At most 64 bytes left: finish with 16-byte copies ending exactly at the end
+    while (n > 16) {
+        copy16(d, s);
+        d += 16;
+        s += 16;
+        n -= 16;
     }
+    copy16(d + n - 16, s + n - 16);
     return dest;
 }
 
-// Memory set - fill memory with a constant byte
+// Memory move - like memcpy but picks a direction that is safe for overlap
+// Every block is fully loaded before it is stored, so block order is enough
+void *memmove(void *dest, const void *src, size_t n) {
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    if (d == s || n == 0) {
+        return dest;
+    }
+    if ((uintptr_t)d - (uintptr_t)s >= n) {
+        // Forward copy never clobbers unread source (d < s or no overlap)
+        while (n >= 64) {
+            copy64(d, s);
+            d += 64;
+            s += 64;
+            n -= 64;
+        }
+        while (n >= 8) {
+            *(u64_ua *)d = *(const u64_ua *)s;
+            d += 8;
+            s += 8;
+            n -= 8;
+        }
+        while (n > 0) {
+            *d++ = *s++;
+            n--;
+        }
+    } else {
+        // dest overlaps the tail of src: copy backwards
+        d += n;
+        s += n;
+        while (n >= 64) {
+            d -= 64;
+            s -= 64;
+            n -= 64;
+            copy64(d, s);
+        }
+        while (n >= 8) {
+            d -= 8;
+            s -= 8;
+            n -= 8;
+            *(u64_ua *)d = *(const u64_ua *)s;
+        }
+        while (n > 0) {
+            *--d = *--s;
+            n--;
+        }
+    }
+    return dest;
+}
+
+// Memory set - fill memory with a constant byte, 64 bytes per iteration
 void *memset(void *s, int c, size_t n) {
     unsigned char *p = (unsigned char *)s;
-    for (size_t i = 0; i < n; i++) {
-        p[i] = (unsigned char)c;
+    uint64_t pattern = (unsigned char)c * 0x0101010101010101ULL;
+
+    if (n < 16) {
+        if (n >= 8) {
+            *(u64_ua *)p = pattern;
+            *(u64_ua *)(p + n - 8) = pattern;
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                p[i] = (unsigned char)c;
+            }
+        }
+        return s;
+    }
+
+    // Unaligned head, then 16-byte aligned blocks, then an overlapping tail
+    *(u64_ua *)p = pattern;
+    *(u64_ua *)(p + 8) = pattern;
+    size_t skew = 16 - ((uintptr_t)p & 15);
+    p += skew;
+    n -= skew;
+
+    while (n >= 64) {
+        fill64(p, pattern);
+        p += 64;
+        n -= 64;
+    }
+    while (n >= 8) {
+        *(u64_ua *)p = pattern;
+        p += 8;
+        n -= 8;
+    }
+    if (n > 0) {
+        *(u64_ua *)(p + n - 8) = pattern;
     }
     return s;
 }
 
+// Memory compare - 8 bytes at a time until the first differing word
+int memcmp(const void *a, const void *b, size_t n) {
+    const unsigned char *p = (const unsigned char *)a;
+    const unsigned char *q = (const unsigned char *)b;
+
+    while (n >= 8 && *(const u64_ua *)p == *(const u64_ua *)q) {
+        p += 8;
+        q += 8;
+        n -= 8;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] != q[i]) {
+            return p[i] - q[i];
+        }
+    }
+    return 0;
+}
+
+// Auxiliary vector handed over by the kernel, found by auxv_init()
+static const Elf64_auxv_t *auxv;
+static unsigned long cached_page_size;
+
+void auxv_init(char **envp) {
+    char **p = envp;
+    while (*p) {
+        p++;
+    }
+    auxv = (const Elf64_auxv_t *)(p + 1);
+    cached_page_size = 0;
+}
+
+unsigned long auxv_get(unsigned long type) {
+    if (!auxv) {
+        return 0;
+    }
+    for (const Elf64_auxv_t *a = auxv; a->a_type != AT_NULL; a++) {
+        if (a->a_type == type) {
+            return a->a_un.a_val;
+        }
+    }
+    return 0;
+}
+
+unsigned long page_size(void) {
+    if (!cached_page_size) {
+        cached_page_size = auxv_get(AT_PAGESZ);
+        if (!cached_page_size) {
+            cached_page_size = 0x1000;
+        }
+    }
+    return cached_page_size;
+}
+
+// Parse an unsigned decimal number; returns 0 for anything else
+unsigned long parse_uint(const char *s) {
+    unsigned long n = 0;
+    if (!s || !*s) {
+        return 0;
+    }
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') {
+            return 0;
+        }
+        n = n * 10 + (*s - '0');
+    }
+    return n;
+}
+
+// Monotonic clock in nanoseconds
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    sys_clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 // String copy - null-terminated
 char *strcpy(char *dest, const char *src) {
     char *d = dest;
@@ -29,6 +287,15 @@ char *strcpy(char *dest, const char *src) {
     return dest;
 }
 
+// String compare
+int strcmp(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
 // String length
 size_t strlen(const char *s) {
     size_t len = 0;
@@ -38,119 +305,316 @@ size_t strlen(const char *s) {
     return len;
 }
 
-// Helper: write string to stdout
-static void write_str(const char *s) {
-    sys_write(1, s, strlen(s));
-}
+// Buffered output sink
+// mini_printf and print_hex_dump append to a buffer instead of issuing one
+// sys_write per character. The buffer is flushed when it fills up, at a
+// newline once it is past OUTPUT_FLUSH_THRESHOLD, by output_flush(), and by
+// _start after main returns.
+#define OUTPUT_BUF_SIZE 4096
+#define OUTPUT_FLUSH_THRESHOLD 3072
 
-// Helper: write single character to stdout
-static void write_char(char c) {
-    sys_write(1, &c, 1);
-}
+// A sink with fd < 0 formats into a caller's buffer (mini_snprintf) and
+// drops whatever does not fit instead of flushing
+struct output_sink {
+    int fd;
+    size_t len;
+    size_t cap;
+    char *buf;
+};
 
-// Helper: convert unsigned integer to decimal string and write
-static void write_uint(unsigned long n) {
-    char buf[32];
-    int i = 0;
+// The buffers are attached on first use: a pointer in a static initializer
+// would need an R_AARCH64_RELATIVE relocation, and nothing applies those to
+// these static-PIE binaries
+static char stdout_buf[OUTPUT_BUF_SIZE];
+static char stderr_buf[OUTPUT_BUF_SIZE];
+static struct output_sink out_stdout = { 1, 0, OUTPUT_BUF_SIZE, NULL };
+static struct output_sink out_stderr = { 2, 0, OUTPUT_BUF_SIZE, NULL };
 
-    if (n == 0) {
-        write_char('0');
-        return;
+static struct output_sink *stdout_sink(void) {
+    if (!out_stdout.buf) {
+        out_stdout.buf = stdout_buf;
     }
+    return &out_stdout;
+}
 
-    while (n > 0) {
-        buf[i++] = '0' + (n % 10);
-        n /= 10;
+static struct output_sink *stderr_sink(void) {
+    if (!out_stderr.buf) {
+        out_stderr.buf = stderr_buf;
     }
+    return &out_stderr;
+}
 
-    // Write in reverse order
-    while (i > 0) {
-        write_char(buf[--i]);
+// Write every byte described by iov, resuming after partial writes
+static void write_all_iov(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        long n = sys_writev(fd, iov, iovcnt);
+        if (n <= 0) {
+            return;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
     }
 }
 
-// Helper: convert signed integer to decimal string and write
-static void write_int(long n) {
-    if (n < 0) {
-        write_char('-');
-        n = -n;
+static void sink_flush(struct output_sink *o) {
+    if (o->len > 0 && o->fd >= 0) {
+        struct iovec iov = { o->buf, o->len };
+        write_all_iov(o->fd, &iov, 1);
+        o->len = 0;
     }
-    write_uint((unsigned long)n);
 }
 
-// Helper: convert unsigned integer to hex string and write
-static void write_hex(unsigned long n, int print_prefix) {
-    char buf[32];
-    int i = 0;
+// Append n bytes; data that does not fit goes out together with the
+// buffered bytes in a single writev instead of being copied in pieces
+static void sink_write(struct output_sink *o, const char *s, size_t n) {
+    if (o->len + n <= o->cap) {
+        memcpy(o->buf + o->len, s, n);
+        o->len += n;
+        return;
+    }
+    if (o->fd < 0) {
+        memcpy(o->buf + o->len, s, o->cap - o->len);
+        o->len = o->cap;
+        return;
+    }
+
+    struct iovec iov[2] = {
+        { o->buf, o->len },
+        { (void *)s, n },
+    };
+    write_all_iov(o->fd, iov, 2);
+    o->len = 0;
+}
 
-    if (print_prefix) {
-        write_str("0x");
+static void sink_putc(struct output_sink *o, char c) {
+    if (o->len == o->cap) {
+        if (o->fd < 0) {
+            return;
+        }
+        sink_flush(o);
     }
+    o->buf[o->len++] = c;
+}
 
-    if (n == 0) {
-        write_char('0');
-        return;
+static void sink_pad(struct output_sink *o, char c, int count) {
+    while (count-- > 0) {
+        sink_putc(o, c);
     }
+}
+
+void output_flush(void) {
+    sink_flush(stdout_sink());
+}
+
+// Helper: write string to stdout
+static void write_str(const char *s) {
+    sink_write(stdout_sink(), s, strlen(s));
+}
 
-    while (n > 0) {
-        int digit = n % 16;
+// Helper: write single character to stdout
+static void write_char(char c) {
+    sink_putc(stdout_sink(), c);
+}
+
+// Helper: convert unsigned integer to digits in the given base
+// Digits are stored least significant first; returns the digit count
+static int format_uint(char *buf, unsigned long n, unsigned base) {
+    int i = 0;
+
+    do {
+        int digit = n % base;
         buf[i++] = (digit < 10) ? ('0' + digit) : ('a' + digit - 10);
-        n /= 16;
-    }
+        n /= base;
+    } while (n > 0);
+
+    return i;
+}
+
+// Format flags parsed from a conversion spec
+#define FMT_LEFT 0x1   // '-': pad on the right
+#define FMT_ZERO 0x2   // '0': pad numbers with zeros
+
+// Helper: write a number with optional prefix ("-" or "0x"), honouring
+// width and padding flags. Zero padding goes between prefix and digits.
+static void write_number(struct output_sink *o, const char *prefix,
+                         const char *digits, int ndigits, int width, int flags) {
+    int plen = strlen(prefix);
+    int pad = width - plen - ndigits;
 
-    // Write in reverse order
-    while (i > 0) {
-        write_char(buf[--i]);
+    if (!(flags & FMT_LEFT) && !(flags & FMT_ZERO)) {
+        sink_pad(o, ' ', pad);
+    }
+    sink_write(o, prefix, plen);
+    if (!(flags & FMT_LEFT) && (flags & FMT_ZERO)) {
+        sink_pad(o, '0', pad);
+    }
+    while (ndigits > 0) {
+        sink_putc(o, digits[--ndigits]);
+    }
+    if (flags & FMT_LEFT) {
+        sink_pad(o, ' ', pad);
     }
 }
 
-// Mini printf implementation
-// Supports: %s (string), %d (decimal), %x (hex), %p (pointer), %% (literal %)
-void mini_printf(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
+// Helper: convert unsigned integer to hex string and write
+static void write_hex(unsigned long n, int print_prefix) {
+    char buf[32];
+    int len = format_uint(buf, n, 16);
+    write_number(stdout_sink(), print_prefix ? "0x" : "", buf, len, 0, 0);
+}
 
+// Mini printf implementation
+// Conversions: %s (string), %c (char), %d (decimal), %u (unsigned),
+// %x (hex), %p (pointer), %% (literal %)
+// 'l' (or 'z') makes %d/%u/%x take a 64-bit argument; a width with
+// optional '-' (left-align) and '0' (zero-pad) flags may precede them
+static void sink_vprintf(struct output_sink *o, const char *fmt, va_list args) {
     for (const char *p = fmt; *p != '\0'; p++) {
-        if (*p == '%') {
+        if (*p != '%') {
+            sink_putc(o, *p);
+            continue;
+        }
+        p++;
+
+        int flags = 0;
+        for (;; p++) {
+            if (*p == '-') {
+                flags |= FMT_LEFT;
+            } else if (*p == '0') {
+                flags |= FMT_ZERO;
+            } else {
+                break;
+            }
+        }
+
+        int width = 0;
+        while (*p >= '0' && *p <= '9') {
+            width = width * 10 + (*p++ - '0');
+        }
+
+        int is_long = 0;
+        while (*p == 'l' || *p == 'z') {
+            is_long = 1;
             p++;
-            switch (*p) {
-                case 's': {
-                    const char *s = va_arg(args, const char *);
-                    write_str(s ? s : "(null)");
-                    break;
-                }
-                case 'd': {
-                    int n = va_arg(args, int);
-                    write_int(n);
-                    break;
-                }
-                case 'x': {
-                    unsigned int n = va_arg(args, unsigned int);
-                    write_hex(n, 0);
-                    break;
-                }
-                case 'p': {
-                    void *p = va_arg(args, void *);
-                    write_hex((unsigned long)p, 1);
-                    break;
+        }
+
+        char buf[32];
+        int len;
+
+        switch (*p) {
+            case 's': {
+                const char *s = va_arg(args, const char *);
+                if (!s) {
+                    s = "(null)";
                 }
-                case '%': {
-                    write_char('%');
-                    break;
+                int slen = strlen(s);
+                if (!(flags & FMT_LEFT)) {
+                    sink_pad(o, ' ', width - slen);
                 }
-                default: {
-                    // Unknown format, just print it
-                    write_char('%');
-                    write_char(*p);
-                    break;
+                sink_write(o, s, slen);
+                if (flags & FMT_LEFT) {
+                    sink_pad(o, ' ', width - slen);
                 }
+                break;
+            }
+            case 'c': {
+                buf[0] = (char)va_arg(args, int);
+                write_number(o, "", buf, 1, width, flags & FMT_LEFT);
+                break;
+            }
+            case 'd':
+            case 'i': {
+                long n = is_long ? va_arg(args, long) : va_arg(args, int);
+                unsigned long u = n < 0 ? -(unsigned long)n : (unsigned long)n;
+                len = format_uint(buf, u, 10);
+                write_number(o, n < 0 ? "-" : "", buf, len, width, flags);
+                break;
+            }
+            case 'u': {
+                unsigned long n = is_long ? va_arg(args, unsigned long)
+                                          : va_arg(args, unsigned int);
+                len = format_uint(buf, n, 10);
+                write_number(o, "", buf, len, width, flags);
+                break;
+            }
+            case 'x': {
+                unsigned long n = is_long ? va_arg(args, unsigned long)
+                                          : va_arg(args, unsigned int);
+                len = format_uint(buf, n, 16);
+                write_number(o, "", buf, len, width, flags);
+                break;
+            }
+            case 'p': {
+                void *ptr = va_arg(args, void *);
+                len = format_uint(buf, (unsigned long)ptr, 16);
+                write_number(o, "0x", buf, len, width, flags);
+                break;
+            }
+            case '%': {
+                sink_putc(o, '%');
+                break;
+            }
+            case '\0': {
+                // Trailing lone '%'
+                p--;
+                break;
+            }
+            default: {
+                // Unknown format, just print it
+                sink_putc(o, '%');
+                sink_putc(o, *p);
+                break;
             }
-        } else {
-            write_char(*p);
         }
     }
+}
 
+void mini_printf(const char *fmt, ...) {
+    struct output_sink *o = stdout_sink();
+    va_list args;
+    va_start(args, fmt);
+    sink_vprintf(o, fmt, args);
+    va_end(args);
+
+    if (o->len >= OUTPUT_FLUSH_THRESHOLD &&
+        o->buf[o->len - 1] == '\n') {
+        sink_flush(o);
+    }
+}
+
+int mini_vsnprintf(char *buf, size_t size, const char *fmt, va_list args) {
+    if (size == 0) {
+        return 0;
+    }
+    struct output_sink o = { -1, 0, size - 1, buf };
+    sink_vprintf(&o, fmt, args);
+    buf[o.len] = '\0';
+    return (int)o.len;
+}
+
+int mini_snprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = mini_vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
+
+// stderr is not buffered across calls: each call is one write
+void mini_eprintf(const char *fmt, ...) {
+    struct output_sink *o = stderr_sink();
+    va_list args;
+    va_start(args, fmt);
+    sink_vprintf(o, fmt, args);
     va_end(args);
+    sink_flush(o);
 }
 
 // Hex dump utility for debugging